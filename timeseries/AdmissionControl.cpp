@@ -0,0 +1,78 @@
+#include "AdmissionControl.h"
+#include <macgyver/Exception.h>
+#include <algorithm>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace TimeSeries
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Constructor
+ */
+// ----------------------------------------------------------------------
+
+AdmissionControl::AdmissionControl(std::size_t theMaxActive,
+                                   std::size_t theMaxQueued,
+                                   std::chrono::milliseconds theMaxWait)
+    : itsMaxActive(std::max<std::size_t>(theMaxActive, 1)),
+      itsMaxQueued(theMaxQueued),
+      itsMaxWait(theMaxWait)
+{
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Wait for a free slot for an expensive request
+ */
+// ----------------------------------------------------------------------
+
+std::unique_ptr<AdmissionControl::Slot> AdmissionControl::admit()
+{
+  try
+  {
+    std::unique_lock<std::mutex> lock(itsMutex);
+
+    if (itsActive >= itsMaxActive)
+    {
+      if (itsQueued >= itsMaxQueued)
+        return {};
+
+      ++itsQueued;
+      const bool ok =
+          itsCondition.wait_for(lock, itsMaxWait, [this] { return itsActive < itsMaxActive; });
+      --itsQueued;
+
+      if (!ok)
+        return {};
+    }
+
+    ++itsActive;
+    return std::make_unique<Slot>(*this);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Release a slot and wake up one waiting request
+ */
+// ----------------------------------------------------------------------
+
+void AdmissionControl::release()
+{
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    --itsActive;
+  }
+  itsCondition.notify_one();
+}
+
+}  // namespace TimeSeries
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,67 @@
+// ======================================================================
+/*!
+ * \brief Admission control for expensive requests
+ *
+ * Requests whose estimated cost exceeds the configured limit may run
+ * only a limited number at a time, so that they cannot occupy all the
+ * server threads. Cheap requests are not limited at all. An expensive
+ * request waits for a free slot for a limited time only, and if too many
+ * are already waiting it is rejected immediately.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace TimeSeries
+{
+class AdmissionControl
+{
+ public:
+  AdmissionControl(std::size_t theMaxActive,
+                   std::size_t theMaxQueued,
+                   std::chrono::milliseconds theMaxWait);
+
+  // The right to run an expensive request, released on destruction
+  class Slot
+  {
+   public:
+    explicit Slot(AdmissionControl& theControl) : itsControl(theControl) {}
+    ~Slot() { itsControl.release(); }
+    Slot(const Slot& other) = delete;
+    Slot& operator=(const Slot& other) = delete;
+
+   private:
+    AdmissionControl& itsControl;
+  };
+
+  // Returns an empty pointer if the request must be rejected
+  std::unique_ptr<Slot> admit();
+
+ private:
+  void release();
+
+  const std::size_t itsMaxActive;
+  const std::size_t itsMaxQueued;
+  const std::chrono::milliseconds itsMaxWait;
+
+  std::mutex itsMutex;
+  std::condition_variable itsCondition;
+  std::size_t itsActive = 0;
+  std::size_t itsQueued = 0;
+};
+
+}  // namespace TimeSeries
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
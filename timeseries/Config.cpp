@@ -342,10 +342,26 @@ Config::Config(const string& configfile)
       itsDefaultUrl(default_url),
       itsDefaultMaxDistance(DEFAULT_MAXDISTANCE),
       itsExpirationTime(default_expires),
+      itsMaxRequestThreads(1),
+      itsTaskPoolThreads(8),
+      itsAdmissionCostLimit(0),
+      itsAdmissionMaxActive(2),
+      itsAdmissionMaxQueued(10),
+      itsAdmissionMaxWait(5000),
+      itsAdmissionRetryAfter(10),
+      itsAdmissionGridResolution(2.5),
+      itsCoalesceMaxWait(0),
       itsObsEngineDisabled(false),
       itsGridEngineDisabled(false),
       itsPreventObsEngineDatabaseQuery(false),
-      itsMaxTimeSeriesCacheSize(10000)
+      itsMaxTimeSeriesCacheSize(10000),
+      itsMaxPointValueCacheSize(5000),
+      itsMaxIndexMaskCacheSize(500),
+      itsMaxLandscapeCacheSize(10000000),
+      itsMaxGeometryCacheSize(500),
+      itsMaxMemoryCacheSize(0),
+      itsMaxFilesystemCacheSize(0),
+      itsFilesystemCacheDirectory("/var/smartmet/timeseriescache")
 {
   try
   {
@@ -377,6 +393,23 @@ Config::Config(const string& configfile)
     itsConfig.lookupValue("gridengine_disabled", itsGridEngineDisabled);
     itsConfig.lookupValue("primaryForecastSource", itsPrimaryForecastSource);
     itsConfig.lookupValue("prevent_observation_database_query", itsPreventObsEngineDatabaseQuery);
+    itsConfig.lookupValue("max_request_threads", itsMaxRequestThreads);
+    if (itsMaxRequestThreads < 1)
+      itsMaxRequestThreads = 1;
+    itsConfig.lookupValue("task_pool_threads", itsTaskPoolThreads);
+
+    // Admission control
+    itsConfig.lookupValue("admission.cost_limit", itsAdmissionCostLimit);
+    itsConfig.lookupValue("admission.max_active", itsAdmissionMaxActive);
+    itsConfig.lookupValue("admission.max_queued", itsAdmissionMaxQueued);
+    itsConfig.lookupValue("admission.max_wait", itsAdmissionMaxWait);
+    itsConfig.lookupValue("admission.retry_after", itsAdmissionRetryAfter);
+    itsConfig.lookupValue("admission.grid_resolution", itsAdmissionGridResolution);
+    if (itsAdmissionMaxActive < 1)
+      itsAdmissionMaxActive = 1;
+
+    // Coalescing of identical concurrent requests
+    itsConfig.lookupValue("coalesce.max_wait", itsCoalesceMaxWait);
 
     if (itsConfig.exists("maxdistance"))
     {
@@ -404,16 +437,16 @@ Config::Config(const string& configfile)
 
     itsConfig.lookupValue("maxradius", itsRequestLimits.maxradius);
 
-    // TODO: Remove deprecated settings detection
-    using Spine::log_time_str;
-    if (itsConfig.exists("cache.memory_bytes"))
-      std::cerr << log_time_str() << " Warning: cache.memory_bytes setting is deprecated\n";
-    if (itsConfig.exists("cache.filesystem_bytes"))
-      std::cerr << log_time_str() << " Warning: cache.filesystem_bytes setting is deprecated\n";
-    if (itsConfig.exists("cache.directory"))
-      std::cerr << log_time_str() << " Warning: cache.directory setting is deprecated\n";
+    // Product cache. The memory cache must be enabled for the filesystem cache to be used.
+    itsConfig.lookupValue("cache.memory_bytes", itsMaxMemoryCacheSize);
+    itsConfig.lookupValue("cache.filesystem_bytes", itsMaxFilesystemCacheSize);
+    itsConfig.lookupValue("cache.directory", itsFilesystemCacheDirectory);
 
     itsConfig.lookupValue("cache.timeseries_size", itsMaxTimeSeriesCacheSize);
+    itsConfig.lookupValue("cache.point_values_size", itsMaxPointValueCacheSize);
+    itsConfig.lookupValue("cache.indexmask_size", itsMaxIndexMaskCacheSize);
+    itsConfig.lookupValue("cache.landscape_points", itsMaxLandscapeCacheSize);
+    itsConfig.lookupValue("cache.geometry_size", itsMaxGeometryCacheSize);
     itsFormatterOptions = Spine::TableFormatterOptions(itsConfig);
 
     parse_config_precisions();
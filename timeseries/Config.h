@@ -66,8 +66,28 @@ class Config
   bool obsEngineDatabaseQueryPrevented() const { return itsPreventObsEngineDatabaseQuery; }
 
   unsigned long long maxTimeSeriesCacheSize() const;
+  unsigned long long maxPointValueCacheSize() const { return itsMaxPointValueCacheSize; }
+  unsigned long long maxIndexMaskCacheSize() const { return itsMaxIndexMaskCacheSize; }
+  unsigned long long maxLandscapeCacheSize() const { return itsMaxLandscapeCacheSize; }
+  unsigned long long maxGeometryCacheSize() const { return itsMaxGeometryCacheSize; }
+  unsigned long long maxMemoryCacheSize() const { return itsMaxMemoryCacheSize; }
+  unsigned long long maxFilesystemCacheSize() const { return itsMaxFilesystemCacheSize; }
+  const std::string& filesystemCacheDirectory() const { return itsFilesystemCacheDirectory; }
 
   unsigned int expirationTime() const { return itsExpirationTime; }
+  unsigned int maxRequestThreads() const { return itsMaxRequestThreads; }
+  unsigned int taskPoolThreads() const { return itsTaskPoolThreads; }
+
+  // Admission control of expensive requests, disabled if the cost limit is zero
+  unsigned long long admissionCostLimit() const { return itsAdmissionCostLimit; }
+  unsigned int admissionMaxActive() const { return itsAdmissionMaxActive; }
+  unsigned int admissionMaxQueued() const { return itsAdmissionMaxQueued; }
+  unsigned int admissionMaxWait() const { return itsAdmissionMaxWait; }
+  unsigned int admissionRetryAfter() const { return itsAdmissionRetryAfter; }
+  double admissionGridResolution() const { return itsAdmissionGridResolution; }
+
+  // Coalescing of identical concurrent requests, disabled if zero
+  unsigned int coalesceMaxWait() const { return itsCoalesceMaxWait; }
   const TS::RequestLimits& requestLimits() const { return itsRequestLimits; };
 
   QueryServer::AliasFileCollection itsAliasFileCollection;
@@ -84,6 +104,15 @@ class Config
   std::string itsDefaultUrl;
   std::string itsDefaultMaxDistance;
   unsigned int itsExpirationTime;
+  unsigned int itsMaxRequestThreads;
+  unsigned int itsTaskPoolThreads;
+  unsigned long long itsAdmissionCostLimit;
+  unsigned int itsAdmissionMaxActive;
+  unsigned int itsAdmissionMaxQueued;
+  unsigned int itsAdmissionMaxWait;
+  unsigned int itsAdmissionRetryAfter;
+  double itsAdmissionGridResolution;
+  unsigned int itsCoalesceMaxWait;
   std::vector<std::string> itsParameterAliasFiles;
   std::vector<uint> itsDefaultGridGeometries;
 
@@ -98,6 +127,13 @@ class Config
   bool itsPreventObsEngineDatabaseQuery;
 
   unsigned long long itsMaxTimeSeriesCacheSize;
+  unsigned long long itsMaxPointValueCacheSize;
+  unsigned long long itsMaxIndexMaskCacheSize;
+  unsigned long long itsMaxLandscapeCacheSize;
+  unsigned long long itsMaxGeometryCacheSize;
+  unsigned long long itsMaxMemoryCacheSize;
+  unsigned long long itsMaxFilesystemCacheSize;
+  std::string itsFilesystemCacheDirectory;
   SmartMet::TimeSeries::RequestLimits itsRequestLimits;
 
   void add_default_precisions();
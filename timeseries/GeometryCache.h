@@ -0,0 +1,53 @@
+// ======================================================================
+/*!
+ * \brief Process wide caches for parsed geometries.
+ *
+ * SVG paths of PostGIS geometries are keyed by the geometry name,
+ * expanded WKT geometries by the WKT and the radius. The caches are
+ * indexed by a hash of the key, but the full key is stored with the
+ * object and compared on every hit so that a hash collision can never
+ * return another geometry. The cached objects are shared between
+ * requests and must never be modified.
+ *
+ */
+// ======================================================================
+
+#pragma once
+
+#include <macgyver/Cache.h>
+#include <newbase/NFmiSvgPath.h>
+#include <memory>
+#include <string>
+
+class OGRGeometry;
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace TimeSeries
+{
+struct CachedSvgPath
+{
+  std::string name;
+  std::shared_ptr<const NFmiSvgPath> path;
+};
+
+struct CachedOGRGeometry
+{
+  std::string wkt;
+  double radius = 0;
+  std::shared_ptr<const OGRGeometry> geometry;
+};
+
+struct GeometryCache
+{
+  explicit GeometryCache(std::size_t theSize) : svgPaths(theSize), ogrGeometries(theSize) {}
+
+  Fmi::Cache::Cache<std::size_t, std::shared_ptr<const CachedSvgPath>> svgPaths;
+  Fmi::Cache::Cache<std::size_t, std::shared_ptr<const CachedOGRGeometry>> ogrGeometries;
+};
+
+}  // namespace TimeSeries
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -94,29 +94,33 @@ void GridEngineQuery::getLocationDefinition(Spine::LocationPtr& loc,
     }
     case Spine::Location::Area:
     {
-      NFmiSvgPath svgPath;
+      std::shared_ptr<const NFmiSvgPath> svgPath;
       loc = get_location_for_area(tloc,
                                   tloc.loc->radius * 1000,
                                   itsPlugin.itsGeometryStorage,
                                   query.language,
                                   *itsPlugin.itsEngines.geoEngine,
+                                  itsPlugin.itsGeometryCache.get(),
                                   &svgPath);
-      convertSvgPathToPolygonPath(svgPath, polygonPath);
+      // The grid library takes a modifiable path, the shared one must not be modified
+      NFmiSvgPath path = *svgPath;
+      convertSvgPathToPolygonPath(path, polygonPath);
       break;
     }
 
     case Spine::Location::Path:
     {
-      NFmiSvgPath svgPath;
+      std::shared_ptr<const NFmiSvgPath> svgPath;
       loc = get_location_for_area(tloc,
                                   tloc.loc->radius * 1000,
                                   itsPlugin.itsGeometryStorage,
                                   query.language,
                                   *itsPlugin.itsEngines.geoEngine,
+                                  itsPlugin.itsGeometryCache.get(),
                                   &svgPath);
       // convertSvgPathToPolygonPath(svgPath,polygonPath);
       Spine::LocationList locationList =
-          get_location_list(svgPath, tloc.tag, query.step, *itsPlugin.itsEngines.geoEngine);
+          get_location_list(*svgPath, tloc.tag, query.step, *itsPlugin.itsEngines.geoEngine);
       std::vector<T::Coordinate> coordinates;
       for (const auto& ll : locationList)
       {
@@ -219,8 +223,8 @@ void GridEngineQuery::getLocationDefinition(Spine::LocationPtr& loc,
 
     default:
     {
-      NFmiSvgPath svgPath;
-      get_svg_path(tloc, itsPlugin.itsGeometryStorage, svgPath);
+      NFmiSvgPath svgPath =
+          *get_svg_path(tloc, itsPlugin.itsGeometryStorage, itsPlugin.itsGeometryCache.get());
       convertSvgPathToPolygonPath(svgPath, polygonPath);
       break;
     }
@@ -232,7 +236,7 @@ bool GridEngineQuery::processGridEngineQuery(const State& state,
                                              TS::OutputData& outputData,
                                              const QueryServer::QueryStreamer_sptr& queryStreamer,
                                              const AreaProducers& areaproducers,
-                                             const ProducerDataPeriod& producerDataPeriod) const
+                                             const ProducerDataPeriod& /* producerDataPeriod */) const
 {
   try
   {
@@ -241,7 +245,17 @@ bool GridEngineQuery::processGridEngineQuery(const State& state,
 
     Fmi::DateTime latestTimestep = query.latestTimestep;
 
-    for (const auto& tloc : query.loptions->locations())
+    const auto& tlocs = query.loptions->locations();
+
+    // Location specific settings and the prepared grid queries
+    std::vector<Spine::LocationPtr> locs;
+    std::vector<std::string> countries;
+    std::vector<AreaProducers> producerList;
+    std::vector<GridInterface::LocationQueries> locationQueries(tlocs.size());
+    GridInterface::QueryTemplates templates;
+
+    std::size_t i = 0;
+    for (const auto& tloc : tlocs)
     {
       query.latestTimestep = latestTimestep;
 
@@ -270,17 +284,50 @@ bool GridEngineQuery::processGridEngineQuery(const State& state,
       if (producers.empty() && !defaultProducer.empty())
         producers.push_back(defaultProducer);
 
-      itsGridInterface->processGridQuery(state,
-                                         query,
-                                         outputData,
-                                         queryStreamer,
-                                         producers,
-                                         producerDataPeriod,
-                                         tloc,
-                                         loc,
-                                         country,
-                                         geometryIdList,
-                                         polygonPath);
+      itsGridInterface->prepareGridQueries(state,
+                                           query,
+                                           queryStreamer,
+                                           producers,
+                                           tloc,
+                                           loc,
+                                           geometryIdList,
+                                           polygonPath,
+                                           templates,
+                                           locationQueries[i++]);
+
+      locs.push_back(loc);
+      countries.push_back(country);
+      producerList.push_back(producers);
+    }
+
+    // Execute the queries of all locations, modes and levels concurrently
+    {
+      TraceSpan span(state, "gridengine", {}, tlocs.size());
+      itsGridInterface->executeGridQueries(locationQueries,
+                                           queryStreamer,
+                                           itsPlugin.itsTaskPool.get(),
+                                           itsPlugin.itsConfig.maxRequestThreads());
+    }
+
+    // Extract the results in the original order
+    i = 0;
+    for (const auto& tloc : tlocs)
+    {
+      query.latestTimestep = latestTimestep;
+
+      itsGridInterface->extractGridQueries(state,
+                                           query,
+                                           outputData,
+                                           queryStreamer,
+                                           producerList[i],
+                                           tloc,
+                                           locs[i],
+                                           countries[i],
+                                           locationQueries[i]);
+      check_request_limit(itsPlugin.itsConfig.requestLimits(),
+                          state.getElementCount(),
+                          TS::RequestLimitMember::ELEMENTS);
+      ++i;
     }
     return true;
   }
@@ -5,6 +5,7 @@
 // ======================================================================
 #include "GridInterface.h"
 #include "LocationTools.h"
+#include "ParallelTasks.h"
 #include "PostProcessing.h"
 #include "State.h"
 #include "UtilityFunctions.h"
@@ -25,6 +26,7 @@
 #include <timeseries/ParameterKeywords.h>
 #include <timeseries/ParameterTools.h>
 #include <timeseries/TimeSeriesUtility.h>
+#include <optional>
 
 #define FUNCTION_TRACE FUNCTION_TRACE_OFF
 
@@ -366,7 +368,8 @@ bool GridInterface::isValidDefaultRequest(
   }
 }
 
-void GridInterface::prepareQueryTimes(QueryServer::Query& gridQuery,
+void GridInterface::prepareQueryTimes(const State& state,
+                                      QueryServer::Query& gridQuery,
                                       const Query& masterquery,
                                       const Spine::LocationPtr& loc)
 {
@@ -376,7 +379,7 @@ void GridInterface::prepareQueryTimes(QueryServer::Query& gridQuery,
     // Timezone accoring to the requested location.
 
     std::string timezoneName = loc->timezone;
-    Fmi::TimeZonePtr tz = itsTimezones.time_zone_from_string(loc->timezone);
+    Fmi::TimeZonePtr tz = state.getTimeZone(loc->timezone);
 
     // If the query contains a specific timezone definition then we should use it instead of
     // the location based time zone.
@@ -384,7 +387,7 @@ void GridInterface::prepareQueryTimes(QueryServer::Query& gridQuery,
     if (masterquery.timezone != "localtime")
     {
       timezoneName = masterquery.timezone;
-      tz = itsTimezones.time_zone_from_string(timezoneName);
+      tz = state.getTimeZone(timezoneName);
     }
 
     // These boolean variables define if the start time and the end time is defined in UTC.
@@ -1046,7 +1049,8 @@ void GridInterface::prepareQueryParameters(QueryServer::Query& gridQuery,
   }
 }
 
-void GridInterface::prepareGridQuery(QueryServer::Query& gridQuery,
+void GridInterface::prepareGridQuery(const State& state,
+                                     QueryServer::Query& gridQuery,
                                      const Query& masterquery,
                                      uint mode,
                                      int origLevelId,
@@ -1055,29 +1059,44 @@ void GridInterface::prepareGridQuery(QueryServer::Query& gridQuery,
                                      const Spine::TaggedLocation& /* tloc */,
                                      const Spine::LocationPtr& loc,
                                      const T::GeometryId_set& geometryIdList,
-                                     std::vector<std::vector<T::Coordinate>>& polygonPath)
+                                     std::vector<std::vector<T::Coordinate>>& polygonPath,
+                                     QueryTemplates& templates)
 {
   FUNCTION_TRACE
   try
   {
-    int levelId = origLevelId;
-    int geometryId = -1;
-    bool sameParamAnalysisTime = false;
     uchar locationType = 0;
+    prepareLocation(gridQuery, masterquery, loc, geometryIdList, polygonPath, locationType);
+
+    // The producer, generation and parameter settings do not depend on the location,
+    // and are shared by all locations of the request with the same location type.
 
-    prepareProducer(gridQuery, masterquery, origLevelId, areaproducers, levelId, geometryId);
-    prepareGeneration(gridQuery, masterquery, sameParamAnalysisTime);
+    auto key = std::make_tuple(mode, origLevelId, origLevel, locationType);
+    auto pos = templates.find(key);
+    if (pos == templates.end())
+    {
+      auto tmpl = std::make_shared<QueryServer::Query>();
+      int levelId = origLevelId;
+      int geometryId = -1;
+      bool sameParamAnalysisTime = false;
+
+      prepareProducer(*tmpl, masterquery, origLevelId, areaproducers, levelId, geometryId);
+      prepareGeneration(*tmpl, masterquery, sameParamAnalysisTime);
+      prepareQueryParameters(*tmpl,
+                             masterquery,
+                             mode,
+                             levelId,
+                             geometryId,
+                             locationType,
+                             sameParamAnalysisTime,
+                             origLevel,
+                             areaproducers);
+      pos = templates.insert(std::make_pair(key, tmpl)).first;
+    }
+
+    gridQuery = *pos->second;
     prepareLocation(gridQuery, masterquery, loc, geometryIdList, polygonPath, locationType);
-    prepareQueryTimes(gridQuery, masterquery, loc);
-    prepareQueryParameters(gridQuery,
-                           masterquery,
-                           mode,
-                           levelId,
-                           geometryId,
-                           locationType,
-                           sameParamAnalysisTime,
-                           origLevel,
-                           areaproducers);
+    prepareQueryTimes(state, gridQuery, masterquery, loc);
   }
   catch (...)
   {
@@ -1602,6 +1621,9 @@ void GridInterface::exteractQueryResult(std::shared_ptr<QueryServer::Query>& gri
           int tLen = gridQuery->mForecastTimeList.size();
           int t = 0;
 
+          // Location parameters do not depend on time, they are formatted only once
+          std::optional<TS::Value> locationValue;
+
           for (auto ft = gridQuery->mForecastTimeList.begin();
                ft != gridQuery->mForecastTimeList.end();
                ++ft)
@@ -1745,14 +1767,15 @@ void GridInterface::exteractQueryResult(std::shared_ptr<QueryServer::Query>& gri
               }
               else if (TS::is_location_parameter(gridQuery->mQueryParameterList[pid].mParam))
               {
-                TS::Value pValue =
-                    TS::location_parameter(loc,
-                                           paramname,
-                                           masterquery.valueformatter,
-                                           timezone,
-                                           gridQuery->mQueryParameterList[pid].mPrecision,
-                                           masterquery.crs);
-                TS::TimedValue tsValue(queryTime, pValue);
+                if (!locationValue)
+                  locationValue =
+                      TS::location_parameter(loc,
+                                             paramname,
+                                             masterquery.valueformatter,
+                                             timezone,
+                                             gridQuery->mQueryParameterList[pid].mPrecision,
+                                             masterquery.crs);
+                TS::TimedValue tsValue(queryTime, *locationValue);
                 tsForNonGridParam->emplace_back(tsValue);
               }
             }
@@ -2271,6 +2294,7 @@ void GridInterface::exteractQueryResult(std::shared_ptr<QueryServer::Query>& gri
 
           if (!tsForNonGridParam->empty())
           {
+            TraceSpan span(state, "aggregation");
             TS::TimeSeriesPtr aggregatedTs = TS::aggregate(
                 tsForNonGridParam,
                 paramFuncs[pIdx].functions,
@@ -2282,6 +2306,7 @@ void GridInterface::exteractQueryResult(std::shared_ptr<QueryServer::Query>& gri
 
         if (!tsForParameter->empty())
         {
+          TraceSpan span(state, "aggregation");
           TS::TimeSeriesPtr aggregatedTs = TS::aggregate(
               tsForParameter,
               paramFuncs[pIdx].functions,
@@ -2292,6 +2317,7 @@ void GridInterface::exteractQueryResult(std::shared_ptr<QueryServer::Query>& gri
 
         if (!tsForGroup->empty())
         {
+          TraceSpan span(state, "aggregation");
           TS::TimeSeriesGroupPtr aggregatedTsg = TS::aggregate(
               tsForGroup,
               paramFuncs[pIdx].functions,
@@ -2300,7 +2326,7 @@ void GridInterface::exteractQueryResult(std::shared_ptr<QueryServer::Query>& gri
           aggregatedData.emplace_back(aggregatedTsg);
         }
 
-        PostProcessing::store_data(aggregatedData, masterquery, outputData);
+        state.addElements(PostProcessing::store_data(aggregatedData, masterquery, outputData));
         pIdx++;
       }
     }
@@ -2311,51 +2337,42 @@ void GridInterface::exteractQueryResult(std::shared_ptr<QueryServer::Query>& gri
   }
 }
 
-void GridInterface::processGridQuery(const State& state,
-                                     Query& masterquery,
-                                     TS::OutputData& outputData,
-                                     const QueryServer::QueryStreamer_sptr& queryStreamer,
-                                     const AreaProducers& areaproducers,
-                                     const ProducerDataPeriod& /* producerDataPeriod */,
-                                     const Spine::TaggedLocation& tloc,
-                                     const Spine::LocationPtr& loc,
-                                     const std::string& country,
-                                     T::GeometryId_set& geometryIdList,
-                                     std::vector<std::vector<T::Coordinate>>& polygonPath)
+void GridInterface::prepareGridQueries(const State& state,
+                                       Query& masterquery,
+                                       const QueryServer::QueryStreamer_sptr& queryStreamer,
+                                       const AreaProducers& areaproducers,
+                                       const Spine::TaggedLocation& tloc,
+                                       const Spine::LocationPtr& loc,
+                                       T::GeometryId_set& geometryIdList,
+                                       std::vector<std::vector<T::Coordinate>>& polygonPath,
+                                       QueryTemplates& templates,
+                                       LocationQueries& locationQueries)
 {
   FUNCTION_TRACE
   try
   {
-    TS::Value missing_value = TS::None();
-
-    auto latestTimestep = masterquery.latestTimestep;
-
     std::string timezoneName = loc->timezone;
-    Fmi::TimeZonePtr localtz = itsTimezones.time_zone_from_string(loc->timezone);
-    Fmi::TimeZonePtr tz = localtz;
+    locationQueries.tz = state.getTimeZone(loc->timezone);
 
     if (masterquery.timezone != "localtime")
     {
       timezoneName = masterquery.timezone;
-      tz = itsTimezones.time_zone_from_string(timezoneName);
+      locationQueries.tz = state.getTimeZone(timezoneName);
     }
 
-    int qLevelId = -1;
     std::string geometryIdStr;
 
-    findLevelId(masterquery, areaproducers, qLevelId, geometryIdStr);
+    findLevelId(masterquery, areaproducers, locationQueries.levelId, geometryIdStr);
 
     for (uint mode = 0; mode < 3; mode++)
     {
       std::vector<double> levels;
-      findLevels(masterquery, areaproducers, mode, qLevelId, levels);
+      findLevels(masterquery, areaproducers, mode, locationQueries.levelId, levels);
 
       // Requesting data level by level.
 
       for (const auto level : levels)
       {
-        masterquery.latestTimestep = latestTimestep;
-
         std::shared_ptr<QueryServer::Query> originalGridQuery(new QueryServer::Query());
 
         if (geometryIdStr > "")
@@ -2365,51 +2382,123 @@ void GridInterface::processGridQuery(const State& state,
         }
 
         // Preparing the Query object.
-        prepareGridQuery(*originalGridQuery,
+        prepareGridQuery(state,
+                         *originalGridQuery,
                          masterquery,
                          mode,
-                         qLevelId,
+                         locationQueries.levelId,
                          level,
                          areaproducers,
                          tloc,
                          loc,
                          geometryIdList,
-                         polygonPath);
-
-        std::vector<TS::TimeSeriesData> tsdatavector;
-        outputData.emplace_back(make_pair(get_location_id(tloc.loc), tsdatavector));
+                         polygonPath,
+                         templates);
 
         if (queryStreamer != nullptr)
         {
           originalGridQuery->mFlags |= QueryServer::Query::Flags::GeometryHitNotRequired;
         }
 
-        // Executing the query. The reqsult query object is returned as a shared pointer to a
-        // Query-object. This object can point to the original query-object as well as a cached
-        // query-object.
+        SubQuery subquery;
+        subquery.level = level;
+        subquery.query = originalGridQuery;
+        locationQueries.queries.emplace_back(subquery);
+      }
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception(BCP, "Operation failed!", nullptr);
+  }
+}
 
-        std::shared_ptr<QueryServer::Query> gridQuery =
-            itsGridEngine->executeQuery(originalGridQuery);
+void GridInterface::executeGridQueries(std::vector<LocationQueries>& locationQueries,
+                                       const QueryServer::QueryStreamer_sptr& queryStreamer,
+                                       TaskPool* taskPool,
+                                       unsigned int maxThreads)
+{
+  FUNCTION_TRACE
+  try
+  {
+    // Streamed queries are executed one by one while the results are extracted
+    if (queryStreamer != nullptr)
+      return;
+
+    std::vector<SubQuery*> subqueries;
+    for (auto& location : locationQueries)
+      for (auto& subquery : location.queries)
+        subqueries.push_back(&subquery);
+
+    // Executing the queries. The result query object is returned as a shared pointer to a
+    // Query-object. This object can point to the original query-object as well as a cached
+    // query-object.
+
+    run_parallel_tasks(taskPool,
+                       subqueries.size(),
+                       maxThreads,
+                       [&](std::size_t i)
+                       {
+                         auto* subquery = subqueries[i];
+                         subquery->result = itsGridEngine->executeQuery(subquery->query);
+                       });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception(BCP, "Operation failed!", nullptr);
+  }
+}
 
-        if (queryStreamer != nullptr)
-        {
-          queryStreamer->init(0, itsGridEngine->getQueryServer_sptr());
-          insertFileQueries(*gridQuery, queryStreamer);
-        }
+void GridInterface::extractGridQueries(const State& state,
+                                       Query& masterquery,
+                                       TS::OutputData& outputData,
+                                       const QueryServer::QueryStreamer_sptr& queryStreamer,
+                                       const AreaProducers& areaproducers,
+                                       const Spine::TaggedLocation& tloc,
+                                       const Spine::LocationPtr& loc,
+                                       const std::string& country,
+                                       LocationQueries& locationQueries)
+{
+  FUNCTION_TRACE
+  try
+  {
+    auto latestTimestep = masterquery.latestTimestep;
+
+    for (auto& subquery : locationQueries.queries)
+    {
+      masterquery.latestTimestep = latestTimestep;
 
-        exteractQueryResult(gridQuery,
-                            state,
-                            masterquery,
-                            outputData,
-                            queryStreamer,
-                            areaproducers,
-                            tz,
-                            tloc,
-                            loc,
-                            country,
-                            qLevelId,
-                            level);
+      std::vector<TS::TimeSeriesData> tsdatavector;
+      outputData.emplace_back(make_pair(get_location_id(tloc.loc), tsdatavector));
+
+      if (!subquery.result)
+      {
+        TraceSpan span(state, "gridengine");
+        subquery.result = itsGridEngine->executeQuery(subquery.query);
+      }
+
+      if (queryStreamer != nullptr)
+      {
+        queryStreamer->init(0, itsGridEngine->getQueryServer_sptr());
+        insertFileQueries(*subquery.result, queryStreamer);
       }
+
+      exteractQueryResult(subquery.result,
+                          state,
+                          masterquery,
+                          outputData,
+                          queryStreamer,
+                          areaproducers,
+                          locationQueries.tz,
+                          tloc,
+                          loc,
+                          country,
+                          locationQueries.levelId,
+                          subquery.level);
+
+      // Release the results as soon as possible
+      subquery.result.reset();
+      subquery.query.reset();
     }
   }
   catch (...)
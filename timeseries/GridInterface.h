@@ -15,6 +15,9 @@
 #include <grid-files/grid/Typedefs.h>
 #include <macgyver/TimeZones.h>
 #include <timeseries/TimeSeriesInclude.h>
+#include <map>
+#include <memory>
+#include <tuple>
 
 namespace SmartMet
 {
@@ -42,11 +45,43 @@ class GridInterface
       static bool     isValidDefaultRequest(const std::vector<uint>& defaultGeometries,
                         const std::vector<std::vector<T::Coordinate>>& polygonPath,T::GeometryId_set& geometryIdList);
 
-      void            processGridQuery(const State& state,Query& query,TS::OutputData& outputData,
+      // A grid query of a single location, mode and level
+      struct SubQuery
+      {
+        double level = 0;
+        std::shared_ptr<QueryServer::Query> query;
+        std::shared_ptr<QueryServer::Query> result;
+      };
+
+      // All grid queries of a single location
+      struct LocationQueries
+      {
+        Fmi::TimeZonePtr tz;
+        int levelId = -1;
+        std::vector<SubQuery> queries;
+      };
+
+      // Location independent parts of the grid queries of a request
+      using QueryTemplates = std::map<std::tuple<uint, int, double, uchar>,
+                                      std::shared_ptr<const QueryServer::Query>>;
+
+      // The queries are prepared first, then executed concurrently, and finally
+      // the results are extracted in the original order.
+
+      void            prepareGridQueries(const State& state,Query& query,
                         const QueryServer::QueryStreamer_sptr& queryStreamer,const AreaProducers& areaproducers,
-                        const ProducerDataPeriod& producerDataPeriod,const Spine::TaggedLocation& tloc,
-                        const Spine::LocationPtr& loc,const std::string& country,T::GeometryId_set& geometryIdList,
-                        std::vector<std::vector<T::Coordinate>>& polygonPath);
+                        const Spine::TaggedLocation& tloc,const Spine::LocationPtr& loc,
+                        T::GeometryId_set& geometryIdList,std::vector<std::vector<T::Coordinate>>& polygonPath,
+                        QueryTemplates& templates,LocationQueries& locationQueries);
+
+      void            executeGridQueries(std::vector<LocationQueries>& locationQueries,
+                        const QueryServer::QueryStreamer_sptr& queryStreamer,TaskPool* taskPool,
+                        unsigned int maxThreads);
+
+      void            extractGridQueries(const State& state,Query& query,TS::OutputData& outputData,
+                        const QueryServer::QueryStreamer_sptr& queryStreamer,const AreaProducers& areaproducers,
+                        const Spine::TaggedLocation& tloc,const Spine::LocationPtr& loc,const std::string& country,
+                        LocationQueries& locationQueries);
 
   private:
 
@@ -78,17 +113,18 @@ class GridInterface
                         const Spine::LocationPtr& loc,const T::GeometryId_set& geometryIdList,
                         std::vector<std::vector<T::Coordinate>>& polygonPath,uchar& locationType);
 
-      void            prepareQueryTimes(QueryServer::Query& gridQuery,const Query& masterquery,
+      void            prepareQueryTimes(const State& state,QueryServer::Query& gridQuery,const Query& masterquery,
                         const Spine::LocationPtr& loc);
 
       void            prepareQueryParameters(QueryServer::Query& gridQuery,const Query& masterquery,
                         uint mode,int levelId,int geometryId,uchar locationType,bool sameParamAnalysisTime,
                         double origLevel,const AreaProducers& areaproducers);
 
-      void            prepareGridQuery(QueryServer::Query& gridQuery,const Query& masterquery,
+      void            prepareGridQuery(const State& state,QueryServer::Query& gridQuery,const Query& masterquery,
                         uint mode,int origLevelId,double origLevel,const AreaProducers& areaproducers,
                         const Spine::TaggedLocation& tloc,const Spine::LocationPtr& loc,
-                        const T::GeometryId_set& geometryIdList,std::vector<std::vector<T::Coordinate>>& polygonPath);
+                        const T::GeometryId_set& geometryIdList,std::vector<std::vector<T::Coordinate>>& polygonPath,
+                        QueryTemplates& templates);
 
 
   private:
@@ -0,0 +1,104 @@
+#include "InFlightRequests.h"
+#include <macgyver/Exception.h>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace TimeSeries
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Constructor
+ */
+// ----------------------------------------------------------------------
+
+InFlightRequests::InFlightRequests(std::chrono::milliseconds theMaxWait) : itsMaxWait(theMaxWait)
+{
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Become the leader for the product or wait for the current leader
+ */
+// ----------------------------------------------------------------------
+
+std::unique_ptr<InFlightRequests::Leader> InFlightRequests::join(
+    std::size_t theKey,
+    const std::string& theRequest,
+    std::shared_ptr<std::string>& theOutput,
+    bool& theRejected)
+{
+  try
+  {
+    const auto deadline = std::chrono::steady_clock::now() + itsMaxWait;
+
+    std::unique_lock<std::mutex> lock(itsMutex);
+
+    while (true)
+    {
+      auto pos = itsFlights.find(theKey);
+      if (pos == itsFlights.end())
+      {
+        auto flight = std::make_shared<Flight>(theRequest);
+        itsFlights.emplace(theKey, flight);
+        return std::make_unique<Leader>(*this, theKey, flight);
+      }
+
+      // Hold a reference since the leader removes the flight when it finishes
+      auto flight = pos->second;
+
+      // Hash collision, the product must be generated independently
+      if (flight->request != theRequest)
+        return {};
+
+      if (!flight->condition.wait_until(lock, deadline, [&flight] { return flight->done; }))
+        return {};
+
+      if (flight->output)
+      {
+        theOutput = flight->output;
+        return {};
+      }
+
+      if (flight->rejected)
+      {
+        theRejected = true;
+        return {};
+      }
+
+      // The leader failed, try to take over
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Hand over the output or the rejection of the leader and wake up the followers
+ */
+// ----------------------------------------------------------------------
+
+void InFlightRequests::finish(std::size_t theKey,
+                              Flight& theFlight,
+                              const std::shared_ptr<std::string>& theOutput,
+                              bool theRejected)
+{
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    if (theFlight.done)
+      return;
+    theFlight.done = true;
+    theFlight.rejected = theRejected;
+    theFlight.output = theOutput;
+    itsFlights.erase(theKey);
+  }
+  theFlight.condition.notify_all();
+}
+
+}  // namespace TimeSeries
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,101 @@
+// ======================================================================
+/*!
+ * \brief Coalescing of identical concurrent requests
+ *
+ * The first request for a product becomes the leader which generates
+ * the output, identical requests arriving meanwhile wait for it and
+ * share the same output string. If the leader fails, one of the waiting
+ * requests takes over. If the leader is rejected by admission control,
+ * the waiting requests are rejected too. Waiting is limited in time,
+ * after which a request generates the product by itself.
+ *
+ * Flights are indexed by the product hash, but the full request key is
+ * stored with the flight and compared on join so that a hash collision
+ * can never hand the output of another request to a follower.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace TimeSeries
+{
+class InFlightRequests
+{
+ private:
+  struct Flight
+  {
+    explicit Flight(std::string theRequest) : request(std::move(theRequest)) {}
+
+    const std::string request;  // the full key of the product
+    std::condition_variable condition;
+    bool done = false;
+    bool rejected = false;
+    std::shared_ptr<std::string> output;  // empty if the leader failed or was rejected
+  };
+
+ public:
+  explicit InFlightRequests(std::chrono::milliseconds theMaxWait);
+
+  // The duty to generate a product, followers are released on destruction
+  class Leader
+  {
+   public:
+    Leader(InFlightRequests& theRequests, std::size_t theKey, std::shared_ptr<Flight> theFlight)
+        : itsRequests(theRequests), itsKey(theKey), itsFlight(std::move(theFlight))
+    {
+    }
+    ~Leader() { itsRequests.finish(itsKey, *itsFlight, {}, false); }
+    Leader(const Leader& other) = delete;
+    Leader& operator=(const Leader& other) = delete;
+
+    void publish(const std::shared_ptr<std::string>& theOutput)
+    {
+      itsRequests.finish(itsKey, *itsFlight, theOutput, false);
+    }
+
+    void reject() { itsRequests.finish(itsKey, *itsFlight, {}, true); }
+
+   private:
+    InFlightRequests& itsRequests;
+    const std::size_t itsKey;
+    const std::shared_ptr<Flight> itsFlight;
+  };
+
+  // Returns a leader if the product must be generated by the caller. Otherwise
+  // theOutput is the output of the leader, or empty if the wait timed out, the
+  // leader was rejected, in which case theRejected is set, or the leader is
+  // generating a different product with the same hash.
+  std::unique_ptr<Leader> join(std::size_t theKey,
+                               const std::string& theRequest,
+                               std::shared_ptr<std::string>& theOutput,
+                               bool& theRejected);
+
+ private:
+  void finish(std::size_t theKey,
+              Flight& theFlight,
+              const std::shared_ptr<std::string>& theOutput,
+              bool theRejected);
+
+  const std::chrono::milliseconds itsMaxWait;
+
+  std::mutex itsMutex;
+  std::map<std::size_t, std::shared_ptr<Flight>> itsFlights;
+};
+
+}  // namespace TimeSeries
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
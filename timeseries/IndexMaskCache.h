@@ -0,0 +1,50 @@
+// ======================================================================
+/*!
+ * \brief Process wide cache for grid index masks of areas.
+ *
+ * Masks are keyed by the grid hash value, the geometry and the radius,
+ * hence the same area is expanded only once for each grid. The cache is
+ * indexed by a hash of the key, but the full key is stored with the mask
+ * and compared on every hit so that a hash collision can never return
+ * the mask of another area.
+ *
+ */
+// ======================================================================
+
+#pragma once
+
+#include <macgyver/Cache.h>
+#include <newbase/NFmiIndexMask.h>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace TimeSeries
+{
+struct IndexMaskKey
+{
+  std::size_t grid = 0;  // hash value of the grid
+  double radius = 0;
+  std::vector<std::tuple<int, double, double>> path;  // type, x and y of the path elements
+
+  bool operator==(const IndexMaskKey& other) const
+  {
+    return (grid == other.grid && radius == other.radius && path == other.path);
+  }
+};
+
+struct IndexMask
+{
+  IndexMaskKey key;
+  std::shared_ptr<const NFmiIndexMask> mask;
+};
+
+using IndexMaskCache = Fmi::Cache::Cache<std::size_t, std::shared_ptr<const IndexMask>>;
+
+}  // namespace TimeSeries
+}  // namespace Plugin
+}  // namespace SmartMet
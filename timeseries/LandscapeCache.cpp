@@ -0,0 +1,135 @@
+// ======================================================================
+/*!
+ * \brief Implementation of LandscapeCache
+ */
+// ======================================================================
+
+#include "LandscapeCache.h"
+#include <engines/geonames/Engine.h>
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <newbase/NFmiGrid.h>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace TimeSeries
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Construct empty arrays for a grid of the given size
+ */
+// ----------------------------------------------------------------------
+
+GridLandscape::GridLandscape(std::size_t theSize) : itsValues(theSize), itsFilled(theSize, 0) {}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get the values for the mask, looking up missing values first
+ *
+ * The missing indices are collected under the lock, looked up without
+ * it and then published under the lock. Concurrent requests may look up
+ * the same point, but the results are identical.
+ */
+// ----------------------------------------------------------------------
+
+std::vector<Landscape> GridLandscape::get(const NFmiIndexMask& theMask,
+                                          const Engine::Querydata::Q& theQ,
+                                          const Engine::Geonames::Engine& theGeoEngine)
+{
+  try
+  {
+    std::vector<Landscape> ret;
+    ret.reserve(theMask.size());
+
+    // Positions in the result and grid indices of the values which must be looked up
+    std::vector<std::pair<std::size_t, std::size_t>> missing;
+
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+      for (const auto& index : theMask)
+      {
+        if (index >= itsValues.size())
+          throw Fmi::Exception(BCP, "Grid index out of bounds in landscape lookup")
+              .addParameter("Index", Fmi::to_string(index))
+              .addParameter("Size", Fmi::to_string(itsValues.size()));
+
+        if (itsFilled[index] == 0)
+          missing.emplace_back(ret.size(), index);
+        ret.push_back(itsValues[index]);
+      }
+    }
+
+    if (missing.empty())
+      return ret;
+
+    for (const auto& [pos, index] : missing)
+    {
+      NFmiPoint coord = theQ->latLon(index);
+      auto& value = ret[pos];
+      value.dem = theGeoEngine.demHeight(coord.X(), coord.Y());
+      value.covertype = theGeoEngine.coverType(coord.X(), coord.Y());
+    }
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+    for (const auto& [pos, index] : missing)
+    {
+      itsValues[index] = ret[pos];
+      itsFilled[index] = 1;
+    }
+
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Construct a cache for the given total number of grid points
+ */
+// ----------------------------------------------------------------------
+
+LandscapeCache::LandscapeCache(std::size_t theMaxPoints) : itsCache(theMaxPoints) {}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get the values for the mask from the arrays of the grid
+ */
+// ----------------------------------------------------------------------
+
+std::vector<Landscape> LandscapeCache::get(const NFmiIndexMask& theMask,
+                                           const Engine::Querydata::Q& theQ,
+                                           const Engine::Geonames::Engine& theGeoEngine)
+{
+  try
+  {
+    const auto hash = theQ->gridHashValue();
+
+    GridLandscapePtr landscape;
+    auto cached_landscape = itsCache.find(hash);
+    if (cached_landscape)
+      landscape = *cached_landscape;
+    else
+    {
+      const auto& grid = theQ->grid();
+      landscape = std::make_shared<GridLandscape>(grid.XNumber() * grid.YNumber());
+      itsCache.insert(hash, landscape);
+    }
+
+    return landscape->get(theMask, theQ, theGeoEngine);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace TimeSeries
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,100 @@
+// ======================================================================
+/*!
+ * \brief Process wide cache for DEM heights and land cover types of grid points.
+ *
+ * Expanding an area into grid points requires the DEM height and the
+ * land cover type of every point. Instead of making separate geonames
+ * calls for each point in each request, the values are stored into
+ * arrays shared by all requests using the same grid. The arrays are
+ * filled lazily as areas are expanded. The values are looked up without
+ * holding the lock of the grid, hence requests expanding different areas
+ * of the same grid do not wait for each other.
+ *
+ * Each grid point takes about 17 bytes, hence the size of the cache is
+ * limited by the total number of grid points instead of the number of
+ * grids.
+ *
+ */
+// ======================================================================
+
+#pragma once
+
+#include <engines/querydata/Q.h>
+#include <gis/LandCover.h>
+#include <macgyver/Cache.h>
+#include <newbase/NFmiIndexMask.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Geonames
+{
+class Engine;
+}
+}  // namespace Engine
+
+namespace Plugin
+{
+namespace TimeSeries
+{
+struct Landscape
+{
+  double dem = 0;
+  Fmi::LandCover::Type covertype{};
+};
+
+class GridLandscape
+{
+ public:
+  explicit GridLandscape(std::size_t theSize);
+
+  // Return the values for the mask indices in the iteration order of the mask
+  std::vector<Landscape> get(const NFmiIndexMask& theMask,
+                             const Engine::Querydata::Q& theQ,
+                             const Engine::Geonames::Engine& theGeoEngine);
+
+  std::size_t size() const { return itsValues.size(); }
+
+ private:
+  std::mutex itsMutex;
+  std::vector<Landscape> itsValues;
+  std::vector<char> itsFilled;
+};
+
+using GridLandscapePtr = std::shared_ptr<GridLandscape>;
+
+// Grids are charged for their number of points
+struct GridLandscapeSize
+{
+  static std::size_t getSize(const GridLandscapePtr& theLandscape) { return theLandscape->size(); }
+};
+
+class LandscapeCache
+{
+ public:
+  explicit LandscapeCache(std::size_t theMaxPoints);
+
+  // Values for the mask indices of the grid of the given querydata
+  std::vector<Landscape> get(const NFmiIndexMask& theMask,
+                             const Engine::Querydata::Q& theQ,
+                             const Engine::Geonames::Engine& theGeoEngine);
+
+  Fmi::Cache::CacheStats getCacheStats() const { return itsCache.statistics(); }
+
+ private:
+  Fmi::Cache::Cache<std::size_t,
+                    GridLandscapePtr,
+                    Fmi::Cache::LRUEviction,
+                    std::size_t,
+                    Fmi::Cache::InstantExpire,
+                    GridLandscapeSize>
+      itsCache;
+};
+
+}  // namespace TimeSeries
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -2,6 +2,7 @@
 #include "LonLatDistance.h"
 #include <grid-files/common/GraphFunctions.h>
 #include <macgyver/Exception.h>
+#include <macgyver/Hash.h>
 #include <newbase/NFmiSvgTools.h>
 #include <timeseries/ParameterKeywords.h>
 
@@ -15,6 +16,39 @@ namespace
 {
 // Construct the locale for case conversions only once
 const std::locale stdlocale = std::locale();
+
+// Parse the SVG path of a PostGIS geometry, only once if the cache is enabled
+std::shared_ptr<const NFmiSvgPath> read_svg_path(
+    const std::string& place,
+    const Engine::Gis::GeometryStorage& geometryStorage,
+    GeometryCache* geometryCache)
+{
+  try
+  {
+    const auto hash = Fmi::hash_value(place);
+    if (geometryCache)
+    {
+      auto cached = geometryCache->svgPaths.find(hash);
+      if (cached && (*cached)->name == place)
+        return (*cached)->path;
+    }
+
+    auto path = std::make_shared<NFmiSvgPath>();
+    std::stringstream svgStringStream(geometryStorage.getSVGPath(place));
+    path->Read(svgStringStream);
+
+    std::shared_ptr<const NFmiSvgPath> ret = path;
+    if (geometryCache)
+      geometryCache->svgPaths.insert(hash,
+                                     std::make_shared<CachedSvgPath>(CachedSvgPath{place, ret}));
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 }  // namespace
 
 // ----------------------------------------------------------------------
@@ -120,36 +154,79 @@ std::unique_ptr<OGRGeometry> get_ogr_geometry(const std::string& wktString, doub
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Shared read only version of get_ogr_geometry
+ *
+ * Use this when the geometry is only inspected, the WKT is then parsed
+ * and expanded only once.
+ */
+// ----------------------------------------------------------------------
+
+std::shared_ptr<const OGRGeometry> get_shared_ogr_geometry(const std::string& wktString,
+                                                           double radius,
+                                                           GeometryCache* geometryCache)
+{
+  try
+  {
+    if (!geometryCache)
+      return get_ogr_geometry(wktString, radius);
+
+    auto wkt = get_name_base(wktString);
+    auto hash = Fmi::hash_value(wkt);
+    Fmi::hash_combine(hash, Fmi::hash_value(radius));
+
+    auto cached = geometryCache->ogrGeometries.find(hash);
+    if (cached && (*cached)->wkt == wkt && (*cached)->radius == radius)
+      return (*cached)->geometry;
+
+    std::shared_ptr<const OGRGeometry> geom = get_ogr_geometry(wktString, radius);
+    if (geom)
+      geometryCache->ogrGeometries.insert(
+          hash,
+          std::make_shared<CachedOGRGeometry>(CachedOGRGeometry{std::move(wkt), radius, geom}));
+
+    return geom;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Fetch geometry as NFmiSvgPath from database
+ *
+ * Paths of PostGIS geometries are shared from the cache, and must not be modified.
  */
 // ----------------------------------------------------------------------
 
-void get_svg_path(const Spine::TaggedLocation& tloc,
-                  const Engine::Gis::GeometryStorage& geometryStorage,
-                  NFmiSvgPath& svgPath)
+std::shared_ptr<const NFmiSvgPath> get_svg_path(const Spine::TaggedLocation& tloc,
+                                                const Engine::Gis::GeometryStorage& geometryStorage,
+                                                GeometryCache* geometryCache)
 {
   try
   {
     Spine::LocationPtr loc = tloc.loc;
     std::string place = get_name_base(loc->name);
 
+    auto svgPath = std::make_shared<NFmiSvgPath>();
+
     if (loc->type == Spine::Location::Place || loc->type == Spine::Location::CoordinatePoint)
     {
-      NFmiSvgTools::PointToSvgPath(svgPath, loc->longitude, loc->latitude);
+      NFmiSvgTools::PointToSvgPath(*svgPath, loc->longitude, loc->latitude);
     }
     else if (loc->type == Spine::Location::Area)
     {
       if (geometryStorage.isPolygon(place))
       {
-        std::stringstream svgStringStream(geometryStorage.getSVGPath(place));
-        svgPath.Read(svgStringStream);
+        return read_svg_path(place, geometryStorage, geometryCache);
       }
       else if (geometryStorage.isPoint(place))
       {
         std::pair<double, double> thePoint = geometryStorage.getPoint(place);
-        NFmiSvgTools::PointToSvgPath(svgPath, thePoint.first, thePoint.second);
+        NFmiSvgTools::PointToSvgPath(*svgPath, thePoint.first, thePoint.second);
       }
       else
       {
@@ -172,7 +249,7 @@ void get_svg_path(const Spine::TaggedLocation& tloc,
         {
           double longitude = Fmi::stod(lonLatVector[i]);
           double latitude = Fmi::stod(lonLatVector[i + 1]);
-          svgPath.push_back(NFmiSvgPath::Element(
+          svgPath->push_back(NFmiSvgPath::Element(
               (i == 0 ? NFmiSvgPath::kElementMoveto : NFmiSvgPath::kElementLineto),
               longitude,
               latitude));
@@ -183,13 +260,12 @@ void get_svg_path(const Spine::TaggedLocation& tloc,
         // path fetched from PostGIS database
         if (geometryStorage.isPolygon(place) || geometryStorage.isLine(place))
         {
-          std::stringstream svgStringStream(geometryStorage.getSVGPath(place));
-          svgPath.Read(svgStringStream);
+          return read_svg_path(place, geometryStorage, geometryCache);
         }
         else if (geometryStorage.isPoint(place))
         {
           std::pair<double, double> thePoint = geometryStorage.getPoint(place);
-          NFmiSvgTools::PointToSvgPath(svgPath, thePoint.first, thePoint.second);
+          NFmiSvgTools::PointToSvgPath(*svgPath, thePoint.first, thePoint.second);
         }
         else
         {
@@ -197,6 +273,8 @@ void get_svg_path(const Spine::TaggedLocation& tloc,
         }
       }
     }
+
+    return svgPath;
   }
   catch (...)
   {
@@ -509,7 +587,8 @@ Spine::LocationPtr get_location_for_area(const Spine::TaggedLocation& tloc,
                                          const Engine::Gis::GeometryStorage& geometryStorage,
                                          const std::string& language,
                                          const Engine::Geonames::Engine& geoengine,
-                                         NFmiSvgPath* svgPath /*= nullptr*/)
+                                         GeometryCache* geometryCache /*= nullptr*/,
+                                         std::shared_ptr<const NFmiSvgPath>* svgPath /*= nullptr*/)
 {
   try
   {
@@ -532,17 +611,18 @@ Spine::LocationPtr get_location_for_area(const Spine::TaggedLocation& tloc,
 
     if (svgPath != nullptr)
     {
-      get_svg_path(tloc, geometryStorage, *svgPath);
+      *svgPath = get_svg_path(tloc, geometryStorage, geometryCache);
+      const auto& path = **svgPath;
 
       if (!geom)
       {
         // get location info for center coordinate
-        bottom = svgPath->begin()->itsY;
-        top = svgPath->begin()->itsY;
-        left = svgPath->begin()->itsX;
-        right = svgPath->begin()->itsX;
+        bottom = path.begin()->itsY;
+        top = path.begin()->itsY;
+        left = path.begin()->itsX;
+        right = path.begin()->itsX;
 
-        for (const auto& element : *svgPath)
+        for (const auto& element : path)
         {
           if (element.itsX < left)
             left = element.itsX;
@@ -577,7 +657,8 @@ Spine::LocationPtr get_location_for_area(const Spine::TaggedLocation& tloc,
                                          const Engine::Gis::GeometryStorage& geometryStorage,
                                          const std::string& language,
                                          const Engine::Geonames::Engine& geoengine,
-                                         NFmiSvgPath* svgPath /*= nullptr*/)
+                                         GeometryCache* geometryCache /*= nullptr*/,
+                                         std::shared_ptr<const NFmiSvgPath>* svgPath /*= nullptr*/)
 {
   try
   {
@@ -612,22 +693,25 @@ Spine::LocationPtr get_location_for_area(const Spine::TaggedLocation& tloc,
     {
       if (wktString.length() > 0)
       {
-        convertWktMultipolygonToSvgPath(wktString, *svgPath);
+        auto path = std::make_shared<NFmiSvgPath>();
+        convertWktMultipolygonToSvgPath(wktString, *path);
+        *svgPath = path;
       }
       else
       {
-        get_svg_path(tloc, geometryStorage, *svgPath);
+        *svgPath = get_svg_path(tloc, geometryStorage, geometryCache);
       }
+      const auto& path = **svgPath;
 
       if (!geom)
       {
         // get location info for center coordinate
-        bottom = svgPath->begin()->itsY;
-        top = svgPath->begin()->itsY;
-        left = svgPath->begin()->itsX;
-        right = svgPath->begin()->itsX;
+        bottom = path.begin()->itsY;
+        top = path.begin()->itsY;
+        left = path.begin()->itsX;
+        right = path.begin()->itsX;
 
-        for (const auto& element : *svgPath)
+        for (const auto& element : path)
         {
           left = std::min(left, element.itsX);
           right = std::max(right, element.itsX);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "GeometryCache.h"
 #include <engines/geonames/Engine.h>
 #include <engines/gis/Engine.h>
 #include <engines/observation/Engine.h>
@@ -24,9 +25,14 @@ const OGRGeometry* get_ogr_geometry(const Spine::TaggedLocation& tloc,
 
 std::unique_ptr<OGRGeometry> get_ogr_geometry(const std::string& wktString, double radius = 0.0);
 
-void get_svg_path(const Spine::TaggedLocation& tloc,
-                  const Engine::Gis::GeometryStorage& geometryStorage,
-                  NFmiSvgPath& svgPath);
+// Cached if geometryCache is not null, the geometry must not be modified
+std::shared_ptr<const OGRGeometry> get_shared_ogr_geometry(const std::string& wktString,
+                                                           double radius,
+                                                           GeometryCache* geometryCache);
+
+std::shared_ptr<const NFmiSvgPath> get_svg_path(const Spine::TaggedLocation& tloc,
+                                                const Engine::Gis::GeometryStorage& geometryStorage,
+                                                GeometryCache* geometryCache);
 
 Spine::LocationList get_location_list(const NFmiSvgPath& thePath,
                                       const std::string& thePathName,
@@ -62,14 +68,16 @@ Spine::LocationPtr get_location_for_area(const Spine::TaggedLocation& tloc,
                                          const Engine::Gis::GeometryStorage& geometryStorage,
                                          const std::string& language,
                                          const Engine::Geonames::Engine& geoengine,
-                                         NFmiSvgPath* svgPath = nullptr);
+                                         GeometryCache* geometryCache = nullptr,
+                                         std::shared_ptr<const NFmiSvgPath>* svgPath = nullptr);
 
 Spine::LocationPtr get_location_for_area(const Spine::TaggedLocation& tloc,
                                          int radius,
                                          const Engine::Gis::GeometryStorage& geometryStorage,
                                          const std::string& language,
                                          const Engine::Geonames::Engine& geoengine,
-                                         NFmiSvgPath* svgPath = nullptr);
+                                         GeometryCache* geometryCache = nullptr,
+                                         std::shared_ptr<const NFmiSvgPath>* svgPath = nullptr);
 
 Spine::TaggedLocationList get_locations_inside_geometry(const Spine::LocationList& locations,
                                                         const OGRGeometry& geom);
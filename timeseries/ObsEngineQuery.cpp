@@ -84,13 +84,13 @@ TS::TimeSeries generate_timeseries(const State& state,
   }
 }
 
-bool is_wkt_point(const Spine::LocationPtr& loc)
+bool is_wkt_point(const Spine::LocationPtr& loc, GeometryCache* geometryCache)
 {
   try
   {
     if (loc->type == Spine::Location::Wkt)
     {
-      auto geom = get_ogr_geometry(loc->name, loc->radius);
+      auto geom = get_shared_ogr_geometry(loc->name, loc->radius, geometryCache);
 
       if (!geom)
         return false;
@@ -166,13 +166,12 @@ Spine::LocationPtr get_loc(const Query& query,
         // sure at least the requested fmisid is correct:
         Spine::Location l(0, 0, "", query.timezone);
         l.fmisid = fmisid;
-        loc.reset(new Spine::Location(l));
+        loc = state.makeLocation(l);
       }
     }
     else
     {
-      Spine::Location location(0, 0, "", query.timezone);
-      loc = std::make_shared<Spine::Location>(location);
+      loc = state.makeLocation(Spine::Location(0, 0, "", query.timezone));
     }
 
     return loc;
@@ -263,14 +262,14 @@ void resolve_time_settings(const std::string& producer,
                            unsigned int aggregationIntervalBehind,
                            unsigned int aggregationIntervalAhead,
                            Engine::Observation::Settings& settings,
-                           const Fmi::TimeZones& timezones)
+                           const State& state)
 {
   try
   {
     // Below are listed optional settings, defaults are set while constructing an
     // ObsEngine::Oracle instance.
 
-    Fmi::TimeZonePtr tz = timezones.time_zone_from_string(query.timezone);
+    Fmi::TimeZonePtr tz = state.getTimeZone(query.timezone);
     Fmi::LocalDateTime ldt_now(now, tz);
     Fmi::DateTime ptime_now =
         (query.toptions.startTimeUTC ? ldt_now.utc_time() : ldt_now.local_time());
@@ -295,16 +294,16 @@ void resolve_time_settings(const std::string& producer,
     {
       if (query.toptions.startTimeUTC)
         query.toptions.startTime =
-            producerDataPeriod.getLocalStartTime(producer, query.timezone, timezones).utc_time();
+            producerDataPeriod.getLocalStartTime(producer, query.timezone, state).utc_time();
       else
         query.toptions.startTime =
-            producerDataPeriod.getLocalStartTime(producer, query.timezone, timezones).local_time();
+            producerDataPeriod.getLocalStartTime(producer, query.timezone, state).local_time();
       if (query.toptions.startTimeUTC)
         query.toptions.endTime =
-            producerDataPeriod.getLocalEndTime(producer, query.timezone, timezones).utc_time();
+            producerDataPeriod.getLocalEndTime(producer, query.timezone, state).utc_time();
       else
         query.toptions.endTime =
-            producerDataPeriod.getLocalEndTime(producer, query.timezone, timezones).local_time();
+            producerDataPeriod.getLocalEndTime(producer, query.timezone, state).local_time();
     }
 
     if (query.starttimeOptionGiven && !query.endtimeOptionGiven)
@@ -378,8 +377,13 @@ void ObsEngineQuery::processObsEngineQuery(const State& state,
 
       std::vector<SettingsInfo> settingsVector;
 
-      getObsSettings(
-          settingsVector, producer, producerDataPeriod, state.getTime(), obsParameters, query);
+      getObsSettings(state,
+                     settingsVector,
+                     producer,
+                     producerDataPeriod,
+                     state.getTime(),
+                     obsParameters,
+                     query);
 
       for (auto& item : settingsVector)
       {
@@ -462,12 +466,11 @@ TS::TimeSeriesVectorPtr ObsEngineQuery::handleObsParametersForPlaces(
     // cases the observation engine has already produced LocalDateTimes in the requested
     // timezone, so leave them alone.
     const bool rezone_to_station = query.useStationTimezone && loc;
-    const auto& timezones = itsPlugin.itsEngines.geoEngine->getTimeZones();
     const std::string& effective_timezone =
         rezone_to_station ? loc->timezone : query.timezone;
     Fmi::TimeZonePtr effective_tz;
     if (rezone_to_station)
-      effective_tz = timezones.time_zone_from_string(effective_timezone);
+      effective_tz = state.getTimeZone(effective_timezone);
 
     // Iterate parameters and store values for all parameters
     // into ret data structure
@@ -490,7 +493,7 @@ TS::TimeSeriesVectorPtr ObsEngineQuery::handleObsParametersForPlaces(
                                          query.precisions[i],
                                          query.crs);
         auto timeseries = generate_timeseries(state, timestep_vector, value);
-        ret->emplace_back(timeseries);
+        ret->emplace_back(std::move(timeseries));
         parameterResultIndexes.insert(std::make_pair(paramname, ret->size() - 1));
       }
       else if (TS::is_time_parameter(paramname))
@@ -507,31 +510,30 @@ TS::TimeSeriesVectorPtr ObsEngineQuery::handleObsParametersForPlaces(
                                                state.getTime(),
                                                *loc,
                                                effective_timezone,
-                                               timezones,
+                                               state.getTimeZones(),
                                                query.outlocale,
                                                *query.timeformatter,
                                                query.timestring);
           timeseries.emplace_back(TS::TimedValue(timestep, value));
         }
-        ret->emplace_back(timeseries);
+        ret->emplace_back(std::move(timeseries));
         parameterResultIndexes.insert(std::make_pair(paramname, ret->size() - 1));
       }
       else if (!obsParameters[i].duplicate)
       {
-        // add data fields fetched from observation
-        auto result = *observation_result;
-        if (result[obs_result_field_index].empty())
+        // add data fields fetched from observation. Each field is used only once,
+        // and the caller replaces the observation result with ours, so move it
+        auto& result_at_index = (*observation_result)[obs_result_field_index];
+        if (result_at_index.empty())
           continue;
 
-        auto result_at_index = result[obs_result_field_index];
-
         // If time independend special parameter contains missing values in some timesteps,
         // replace them with existing values to keep aggregation working
 
         if (is_location_p)
           fill_missing_location_params(result_at_index);
 
-        ret->push_back(result_at_index);
+        ret->push_back(std::move(result_at_index));
         std::string pname_plus_snumber = TS::get_parameter_id(obsParameters[i].param);
         parameterResultIndexes.insert(std::make_pair(pname_plus_snumber, ret->size() - 1));
         obs_result_field_index++;
@@ -555,33 +557,48 @@ TS::TimeSeriesVectorPtr ObsEngineQuery::doAggregationForPlaces(
   try
   {
     TS::TimeSeriesVectorPtr aggregated_observation_result(new TS::TimeSeriesVector());
-    // iterate parameters and do aggregation
+    aggregated_observation_result->reserve(obsParameters.size());
+
+    // The same result may be requested several times, for example with different
+    // aggregation functions. Find which parameter uses each result last.
+    std::vector<int> resultIndexes;
+    resultIndexes.reserve(obsParameters.size());
+    std::map<unsigned int, std::size_t> lastUse;
     for (const auto& obsParam : obsParameters)
     {
-      std::string paramname = obsParam.param.name();
-      std::string pname_plus_snumber = TS::get_parameter_id(obsParam.param);
-      if (parameterResultIndexes.find(pname_plus_snumber) != parameterResultIndexes.end())
-        paramname = pname_plus_snumber;
-      else if (parameterResultIndexes.find(paramname) == parameterResultIndexes.end())
+      auto pos = parameterResultIndexes.find(TS::get_parameter_id(obsParam.param));
+      if (pos == parameterResultIndexes.end())
+        pos = parameterResultIndexes.find(obsParam.param.name());
+      if (pos == parameterResultIndexes.end())
+      {
+        resultIndexes.push_back(-1);
+        continue;
+      }
+      lastUse[pos->second] = resultIndexes.size();
+      resultIndexes.push_back(static_cast<int>(pos->second));
+    }
+
+    // iterate parameters and do aggregation
+    for (std::size_t i = 0; i < obsParameters.size(); i++)
+    {
+      if (resultIndexes[i] < 0)
         continue;
 
-      unsigned int resultIndex = parameterResultIndexes.at(paramname);
-      TS::TimeSeries ts = (*observation_result)[resultIndex];
-      TS::DataFunctions pfunc = obsParam.functions;
-      TS::TimeSeriesPtr tsptr;
+      unsigned int resultIndex = resultIndexes[i];
+      TS::TimeSeries& ts = (*observation_result)[resultIndex];
+      const TS::DataFunctions& pfunc = obsParameters[i].functions;
       // If inner function exists aggregation happens
       if (pfunc.innerFunction.exists())
       {
-        tsptr = TS::Aggregator::aggregate(ts, pfunc, agg_times);
+        TS::TimeSeriesPtr tsptr = TS::Aggregator::aggregate(ts, pfunc, agg_times);
         if (tsptr->empty())
           continue;
+        aggregated_observation_result->push_back(std::move(*tsptr));
       }
+      else if (lastUse.at(resultIndex) == i)
+        aggregated_observation_result->push_back(std::move(ts));
       else
-      {
-        tsptr = std::make_shared<TS::TimeSeries>();
-        *tsptr = ts;
-      }
-      aggregated_observation_result->push_back(*tsptr);
+        aggregated_observation_result->push_back(ts);
     }
     return aggregated_observation_result;
   }
@@ -606,6 +623,7 @@ void ObsEngineQuery::fetchObsEngineValuesForPlaces(const State& state,
     // Quick query if there is no aggregation
     if (!query.timeAggregationRequested)
     {
+      TraceSpan span(state, "obsengine", producer, settings.taggedFMISIDs.size());
       observation_result = itsPlugin.itsEngines.obsEngine->values(settings, query.toptions);
     }
     else
@@ -619,6 +637,7 @@ void ObsEngineQuery::fetchObsEngineValuesForPlaces(const State& state,
       settings.timestep = 1;
 
       // fetches results for all location and all parameters
+      TraceSpan span(state, "obsengine", producer, settings.taggedFMISIDs.size());
       observation_result = itsPlugin.itsEngines.obsEngine->values(settings, tmpoptions);
     }
 #ifdef MYDEBYG
@@ -632,7 +651,7 @@ void ObsEngineQuery::fetchObsEngineValuesForPlaces(const State& state,
     int fmisid_index = get_fmisid_index(settings);
 
     TS::TimeSeriesGeneratorCache::TimeList tlist;
-    auto tz = itsPlugin.itsEngines.geoEngine->getTimeZones().time_zone_from_string(query.timezone);
+    auto tz = state.getTimeZone(query.timezone);
     // If query.toptions.startTime == query.toptions.endTime and timestep is missing
     // use minutes as timestep
     if (!query.toptions.timeStep && query.toptions.startTime == query.toptions.endTime)
@@ -657,7 +676,7 @@ void ObsEngineQuery::fetchObsEngineValuesForPlaces(const State& state,
         (query.toptions.all() || UtilityFunctions::is_flash_producer(producer) ||
          UtilityFunctions::is_mobile_producer(producer) || producer == SYKE_PRODUCER);
 
-    // Cache the last resolved timezone to avoid repeated exclusive-lock cache lookups
+    // Cache the last resolved timezone to avoid regenerating the time list
     // when consecutive stations share the same timezone (the common case).
     std::string prev_timezone;
     Fmi::TimeZonePtr prev_tz;
@@ -680,8 +699,7 @@ void ObsEngineQuery::fetchObsEngineValuesForPlaces(const State& state,
         if (loc->timezone != prev_timezone)
         {
           prev_timezone = loc->timezone;
-          prev_tz = itsPlugin.itsEngines.geoEngine->getTimeZones().time_zone_from_string(
-              loc->timezone);
+          prev_tz = state.getTimeZone(loc->timezone);
           if (!query.toptions.all())
             prev_tlist = itsPlugin.itsTimeSeriesCache->generate(query.toptions, prev_tz);
         }
@@ -719,8 +737,12 @@ void ObsEngineQuery::fetchObsEngineValuesForPlaces(const State& state,
         agg_times = station_tlist.get();
       }
 
-      auto aggregated_observation_result = doAggregationForPlaces(
-          state, obsParameters, observation_result, *agg_times, parameterResultIndexes);
+      TS::TimeSeriesVectorPtr aggregated_observation_result;
+      {
+        TraceSpan span(state, "aggregation");
+        aggregated_observation_result = doAggregationForPlaces(
+            state, obsParameters, observation_result, *agg_times, parameterResultIndexes);
+      }
 
       if (aggregated_observation_result->empty())
       {
@@ -737,7 +759,11 @@ void ObsEngineQuery::fetchObsEngineValuesForPlaces(const State& state,
       aggregated_observation_result =
           TS::erase_redundant_timesteps(aggregated_observation_result, *agg_times);
 
-      PostProcessing::store_data(aggregated_observation_result, query, outputData);
+      // Observations count against the element limit of the request like other data
+      auto elements = PostProcessing::store_data(aggregated_observation_result, query, outputData);
+      check_request_limit(itsPlugin.itsConfig.requestLimits(),
+                          state.addElements(elements),
+                          TS::RequestLimitMember::ELEMENTS);
     }
   }
   catch (...)
@@ -829,12 +855,11 @@ TS::TimeSeriesVectorPtr ObsEngineQuery::handleObsParametersForArea(
     // cases the observation engine has already produced LocalDateTimes in the requested
     // timezone, so leave them alone.
     const bool rezone_to_station = query.useStationTimezone && loc;
-    const auto& timezones = itsPlugin.itsEngines.geoEngine->getTimeZones();
     const std::string& effective_timezone =
         rezone_to_station ? loc->timezone : query.timezone;
     Fmi::TimeZonePtr effective_tz;
     if (rezone_to_station)
-      effective_tz = timezones.time_zone_from_string(effective_timezone);
+      effective_tz = state.getTimeZone(effective_timezone);
 
     unsigned int obs_result_field_index = 0;
     for (unsigned int i = 0; i < obsParameters.size(); i++)
@@ -846,20 +871,19 @@ TS::TimeSeriesVectorPtr ObsEngineQuery::handleObsParametersForArea(
           !UtilityFunctions::is_flash_or_mobile_producer(producer))
       {
         TS::TimeSeries location_ts;
+        location_ts.reserve(ts_vector.size());
 
-        for (const auto& ts : ts_vector)
-        {
-          TS::Value value;
-          if (loc)
-            value = TS::location_parameter(loc,
-                                           obsParameters[i].param.name(),
-                                           query.valueformatter,
-                                           effective_timezone,
-                                           query.precisions[i],
-                                           query.crs);
+        TS::Value value;
+        if (loc)
+          value = TS::location_parameter(loc,
+                                         obsParameters[i].param.name(),
+                                         query.valueformatter,
+                                         effective_timezone,
+                                         query.precisions[i],
+                                         query.crs);
 
+        for (const auto& ts : ts_vector)
           location_ts.emplace_back(TS::TimedValue(ts, value));
-        }
         observation_result_with_added_fields->push_back(location_ts);
       }
       else if (TS::is_time_parameter(paramname))
@@ -879,7 +903,7 @@ TS::TimeSeriesVectorPtr ObsEngineQuery::handleObsParametersForArea(
                                                state.getTime(),
                                                (loc ? *loc : dummyloc),
                                                effective_timezone,
-                                               timezones,
+                                               state.getTimeZones(),
                                                query.outlocale,
                                                *query.timeformatter,
                                                query.timestring);
@@ -921,8 +945,11 @@ void ObsEngineQuery::fetchObsEngineValuesForArea(const State& state,
   try
   {
     // fetches results for all locations in the area and all parameters
-    TS::TimeSeriesVectorPtr observation_result =
-        itsPlugin.itsEngines.obsEngine->values(settings, query.toptions);
+    TS::TimeSeriesVectorPtr observation_result;
+    {
+      TraceSpan span(state, "obsengine", producer);
+      observation_result = itsPlugin.itsEngines.obsEngine->values(settings, query.toptions);
+    }
 
 #ifdef MYDEBYG
     std::cout << "observation_result for area: " << *observation_result << std::endl;
@@ -1017,17 +1044,17 @@ void ObsEngineQuery::fetchObsEngineValuesForArea(const State& state,
 
     // iterate locations
 
-    for (const auto& tsv_area : tsv_area_with_added_fields)
+    for (auto& tsv_area : tsv_area_with_added_fields)
     {
-      const TS::TimeSeriesVector* tsv = tsv_area.second.get();
+      TS::TimeSeriesVector* tsv = tsv_area.second.get();
 
-      // iterate fields
+      // iterate fields, the per location series are not needed afterwards
       for (unsigned int k = 0; k < tsv->size(); k++)
       {
         // add k:th time series to the group
         TS::LonLat lonlat(0, 0);  // location is not relevant here
-        TS::LonLatTimeSeries lonlat_ts(lonlat, tsv->at(k));
-        tsg_vector[k]->push_back(lonlat_ts);
+        tsg_vector[k]->emplace_back(lonlat, TS::TimeSeries());
+        tsg_vector[k]->back().timeseries = std::move(tsv->at(k));
       }
     }
 
@@ -1041,10 +1068,17 @@ void ObsEngineQuery::fetchObsEngineValuesForArea(const State& state,
 #endif
 
     TS::Value missing_value = TS::None();
+
+    // Find the last parameter using each data column, the rest need a copy of the data
+    std::map<unsigned int, std::size_t> lastUse;
+    for (std::size_t i = 0; i < obsParameters.size(); i++)
+      lastUse[obsParameters[i].data_column] = i;
+
     // iterate parameters, aggregate, and store aggregated result
 
-    for (const auto& obsparam : obsParameters)
+    for (std::size_t i = 0; i < obsParameters.size(); i++)
     {
+      const auto& obsparam = obsParameters[i];
       unsigned int data_column = obsparam.data_column;
       TS::TimeSeriesGroupPtr tsg = tsg_vector.at(data_column);
 
@@ -1066,22 +1100,22 @@ void ObsEngineQuery::fetchObsEngineValuesForArea(const State& state,
       {
         // Else accept only the original generated timesteps
         // Generate requested timesteps
-        auto tz =
-            itsPlugin.itsEngines.geoEngine->getTimeZones().time_zone_from_string(query.timezone);
+        auto tz = state.getTimeZone(query.timezone);
         tlist = *(itsPlugin.itsTimeSeriesCache->generate(query.toptions, tz));
       }
 
-      TS::DataFunctions pfunc = obsparam.functions;
+      const TS::DataFunctions& pfunc = obsparam.functions;
       // Do the aggregation if requasted
-      TS::TimeSeriesGroupPtr aggregated_tsg(new TS::TimeSeriesGroup);
+      TS::TimeSeriesGroupPtr aggregated_tsg;
       if (pfunc.innerFunction.exists())
       {
-        *aggregated_tsg = *(TS::aggregate(tsg, pfunc, tlist));
+        TraceSpan span(state, "aggregation");
+        aggregated_tsg = TS::aggregate(tsg, pfunc, tlist);
       }
+      else if (lastUse.at(data_column) == i)
+        aggregated_tsg = tsg;
       else
-      {
-        *aggregated_tsg = *tsg;
-      }
+        aggregated_tsg = std::make_shared<TS::TimeSeriesGroup>(*tsg);
 
       aggregated_tsg = TS::erase_redundant_timesteps(aggregated_tsg, tlist);
 
@@ -1095,7 +1129,10 @@ void ObsEngineQuery::fetchObsEngineValuesForArea(const State& state,
 
       // store observation data
       aggregatedData.emplace_back(aggregated_tsg);
-      PostProcessing::store_data(aggregatedData, query, outputData);
+      auto elements = PostProcessing::store_data(aggregatedData, query, outputData);
+      check_request_limit(itsPlugin.itsConfig.requestLimits(),
+                          state.addElements(elements),
+                          TS::RequestLimitMember::ELEMENTS);
     }
   }
   catch (...)
@@ -1128,7 +1165,7 @@ void ObsEngineQuery::handleLocationSettings(
     bool point_location =
         (((loc->type == Spine::Location::Place || loc->type == Spine::Location::CoordinatePoint) &&
           loc->radius == 0) ||
-         is_wkt_point(loc));
+         is_wkt_point(loc, itsPlugin.itsGeometryCache.get()));
 
     if (point_location && !UtilityFunctions::is_flash_or_mobile_producer(producer))
     {
@@ -1160,7 +1197,8 @@ void ObsEngineQuery::handleLocationSettings(
   }
 }
 
-void ObsEngineQuery::getObsSettings(std::vector<SettingsInfo>& settingsVector,
+void ObsEngineQuery::getObsSettings(const State& state,
+                                    std::vector<SettingsInfo>& settingsVector,
                                     const std::string& producer,
                                     const ProducerDataPeriod& producerDataPeriod,
                                     const Fmi::DateTime& now,
@@ -1193,7 +1231,7 @@ void ObsEngineQuery::getObsSettings(std::vector<SettingsInfo>& settingsVector,
                           aggregationIntervalBehind,
                           aggregationIntervalAhead,
                           settings,
-                          itsPlugin.itsEngines.geoEngine->getTimeZones());
+                          state);
 
     // Handle endtime=now
     if (query.latestObservation)
@@ -1496,7 +1534,7 @@ void ObsEngineQuery::resolveStationsForPath(
         }
         wkt += ")";
 
-        std::unique_ptr<OGRGeometry> geom = get_ogr_geometry(wkt, radius);
+        auto geom = get_shared_ogr_geometry(wkt, radius, itsPlugin.itsGeometryCache.get());
         wktString = Fmi::OGR::exportToWkt(*geom);
       }
       else
@@ -1613,7 +1651,7 @@ void ObsEngineQuery::resolveStationsForBBox(
     if (!wkt.empty())
       wkt += "))";
 
-    std::unique_ptr<OGRGeometry> geom = get_ogr_geometry(wkt, loc->radius);
+    auto geom = get_shared_ogr_geometry(wkt, loc->radius, itsPlugin.itsGeometryCache.get());
     wktString = Fmi::OGR::exportToWkt(*geom);
     if (!UtilityFunctions::is_flash_or_mobile_producer(producer) ||
         UtilityFunctions::is_icebuoy_or_copernicus_producer(producer))
@@ -1646,7 +1684,7 @@ void ObsEngineQuery::resolveStationsForPlaceWithRadius(
     wkt += Fmi::to_string(loc->latitude);
     wkt += ")";
 
-    std::unique_ptr<OGRGeometry> geom = get_ogr_geometry(wkt, loc->radius);
+    auto geom = get_shared_ogr_geometry(wkt, loc->radius, itsPlugin.itsGeometryCache.get());
     wktString = Fmi::OGR::exportToWkt(*geom);
     if (!UtilityFunctions::is_flash_or_mobile_producer(producer) ||
         UtilityFunctions::is_icebuoy_or_copernicus_producer(producer))
@@ -1694,7 +1732,7 @@ void ObsEngineQuery::resolveStationsForCoordinatePointWithRadius(
       wkt += Fmi::to_string(loc->latitude);
       wkt += ")";
 
-      std::unique_ptr<OGRGeometry> geom = get_ogr_geometry(wkt, loc->radius);
+      auto geom = get_shared_ogr_geometry(wkt, loc->radius, itsPlugin.itsGeometryCache.get());
       wktString = Fmi::OGR::exportToWkt(*geom);
     }
 
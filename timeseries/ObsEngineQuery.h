@@ -65,7 +65,8 @@ class ObsEngineQuery
                                    Engine::Observation::Settings& settings,
                                    Query& query,
                                    TS::OutputData& outputData) const;
-  void getObsSettings(std::vector<SettingsInfo>& settingsVector,
+  void getObsSettings(const State& state,
+                      std::vector<SettingsInfo>& settingsVector,
                       const std::string& producer,
                       const ProducerDataPeriod& producerDataPeriod,
                       const Fmi::DateTime& now,
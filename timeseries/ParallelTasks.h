@@ -0,0 +1,123 @@
+// ======================================================================
+/*!
+ * \brief Run independent tasks of a single request in parallel.
+ *
+ * The helpers run in the process wide task pool, and their number is
+ * capped per request so that one huge query cannot starve the server.
+ * The calling thread participates in the work, hence the tasks complete
+ * even if the pool is busy and no helper ever starts. The first exception
+ * thrown by any task is rethrown once all started helpers have finished.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "TaskPool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace TimeSeries
+{
+// Call theTask(i) for i = 0...theCount-1 using at most theMaxThreads threads
+template <typename Task>
+void run_parallel_tasks(TaskPool* thePool,
+                        std::size_t theCount,
+                        std::size_t theMaxThreads,
+                        const Task& theTask)
+{
+  const std::size_t nthreads = std::min(theCount, std::max<std::size_t>(theMaxThreads, 1));
+
+  if (thePool == nullptr || nthreads <= 1)
+  {
+    for (std::size_t i = 0; i < theCount; i++)
+      theTask(i);
+    return;
+  }
+
+  std::atomic<std::size_t> next{0};
+  std::atomic<bool> failed{false};
+  std::exception_ptr error;
+  std::mutex error_mutex;
+
+  auto worker = [&]()
+  {
+    while (!failed)
+    {
+      const std::size_t i = next++;
+      if (i >= theCount)
+        return;
+      try
+      {
+        theTask(i);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error)
+          error = std::current_exception();
+        failed = true;
+      }
+    }
+  };
+
+  // Helpers which start only after the caller has finished must not touch its stack
+  struct Helpers
+  {
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::size_t active = 0;
+    bool closed = false;
+  };
+  auto helpers = std::make_shared<Helpers>();
+
+  auto helper = [helpers, &worker]()
+  {
+    {
+      std::lock_guard<std::mutex> lock(helpers->mutex);
+      if (helpers->closed)
+        return;
+      ++helpers->active;
+    }
+    worker();
+    {
+      std::lock_guard<std::mutex> lock(helpers->mutex);
+      --helpers->active;
+    }
+    helpers->condition.notify_all();
+  };
+
+  try
+  {
+    for (std::size_t i = 1; i < nthreads; i++)
+      if (!thePool->submit(helper))
+        break;
+  }
+  catch (...)
+  {
+    // Could not queue all helpers, the ones already queued and the caller will do the work
+  }
+
+  worker();
+
+  {
+    std::unique_lock<std::mutex> lock(helpers->mutex);
+    helpers->closed = true;
+    helpers->condition.wait(lock, [&helpers] { return helpers->active == 0; });
+  }
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+}  // namespace TimeSeries
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -5,12 +5,15 @@
 // ======================================================================
 
 #include "Plugin.h"
+#include "LocationTools.h"
 #include "QueryProcessingHub.h"
 #include "State.h"
 #include "UtilityFunctions.h"
+#include <boost/math/constants/constants.hpp>
 #include <engines/gis/Engine.h>
 #include <fmt/format.h>
 #include <macgyver/Hash.h>
+#include <newbase/NFmiSvgPath.h>
 #include <spine/Convenience.h>
 #include <spine/FmiApiKey.h>
 #include <spine/HostInfo.h>
@@ -19,6 +22,9 @@
 #include <timeseries/ParameterKeywords.h>
 #include <timeseries/LocationParameters.h>
 #include <timeseries/TimeParameters.h>
+#include <cmath>
+#include <limits>
+#include <optional>
 
 // #define MYDEBUG ON
 
@@ -48,6 +54,10 @@ Spine::TableFormatter* get_formatter_and_qstreamer(const Query& q,
     if (strcasecmp(q.format.c_str(), "INFO") == 0)
       return Spine::TableFormatterFactory::create("debug");
 
+    // The execution plan is output as JSON
+    if (strcasecmp(q.format.c_str(), "EXPLAIN") == 0)
+      return Spine::TableFormatterFactory::create("json");
+
     return Spine::TableFormatterFactory::create(q.format);
   }
   catch (...)
@@ -125,6 +135,32 @@ std::string get_wxml_type(const std::string& producer_option,
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Test whether an If-None-Match header matches the given ETag
+ */
+// ----------------------------------------------------------------------
+
+bool etag_matches(const std::string& if_none_match, const std::string& etag)
+{
+  try
+  {
+    std::vector<std::string> tags;
+    boost::algorithm::split(tags, if_none_match, boost::algorithm::is_any_of(","));
+    for (auto& tag : tags)
+    {
+      boost::algorithm::trim(tag);
+      if (tag == "*" || tag == etag || tag == "W/" + etag)
+        return true;
+    }
+    return false;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 bool etag_only(const Spine::HTTP::Request& request,
                Spine::HTTP::Response& response,
                std::size_t product_hash)
@@ -133,7 +169,8 @@ bool etag_only(const Spine::HTTP::Request& request,
   {
     if (product_hash != Fmi::bad_hash)
     {
-      response.setHeader("ETag", fmt::format("\"{:x}-timeseries\"", product_hash));
+      const auto etag = fmt::format("\"{:x}-timeseries\"", product_hash);
+      response.setHeader("ETag", etag);
 
       // If the product is cacheable and etag was requested, respond with etag only
 
@@ -142,6 +179,15 @@ bool etag_only(const Spine::HTTP::Request& request,
         response.setStatus(Spine::HTTP::Status::no_content);
         return true;
       }
+
+      // Revalidation of a product the client already has
+
+      auto if_none_match = request.getHeader("If-None-Match");
+      if (if_none_match && etag_matches(*if_none_match, etag))
+      {
+        response.setStatus(Spine::HTTP::Status::not_modified);
+        return true;
+      }
     }
     return false;
   }
@@ -151,6 +197,47 @@ bool etag_only(const Spine::HTTP::Request& request,
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief The full key of a request for coalescing
+ */
+// ----------------------------------------------------------------------
+
+std::string request_key(const Spine::HTTP::Request& request)
+{
+  try
+  {
+    std::string key;
+    for (const auto& name_value : request.getParameterMap())
+      key.append(name_value.first).append("=").append(name_value.second).append("&");
+    return key;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Reject an expensive request when the server is busy
+ */
+// ----------------------------------------------------------------------
+
+void reject_busy(Spine::HTTP::Response& response, unsigned int retry_after)
+{
+  try
+  {
+    response.setStatus(Spine::HTTP::Status::service_unavailable);
+    response.setHeader("Retry-After", Fmi::to_string(retry_after));
+    response.setHeader("X-TimeSeriesPlugin-Error", "Too many expensive requests, try again later");
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 void parse_lonlats(const std::optional<std::string>& lonlats,
                    Spine::HTTP::Request& theRequest,
                    std::string& wkt_multipoint)
@@ -303,6 +390,62 @@ void parse_wmos(const std::optional<std::string>& wmo,
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Estimated number of grid points in a bounding box
+ *
+ * The box is widened by the radius, and the grid is assumed to have the
+ * given resolution in kilometers.
+ */
+// ----------------------------------------------------------------------
+
+std::size_t estimate_area_points(double theMinLon,
+                                 double theMinLat,
+                                 double theMaxLon,
+                                 double theMaxLat,
+                                 double theRadius,
+                                 double theResolution)
+{
+  const double km_per_degree = 111.2;
+  const double midlat = (theMinLat + theMaxLat) / 2 * boost::math::constants::pi<double>() / 180;
+  const double width =
+      (theMaxLon - theMinLon) * km_per_degree * std::cos(midlat) + 2 * theRadius;
+  const double height = (theMaxLat - theMinLat) * km_per_degree + 2 * theRadius;
+  const double resolution = std::max(theResolution, 0.001);
+  return static_cast<std::size_t>((width / resolution + 1) * (height / resolution + 1));
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Estimated number of grid points covered by a path
+ */
+// ----------------------------------------------------------------------
+
+std::size_t estimate_area_points(const NFmiSvgPath& thePath,
+                                 double theRadius,
+                                 double theResolution)
+{
+  bool empty = true;
+  double minlon = 0;
+  double minlat = 0;
+  double maxlon = 0;
+  double maxlat = 0;
+  for (const auto& element : thePath)
+  {
+    if (element.itsType != NFmiSvgPath::kElementMoveto &&
+        element.itsType != NFmiSvgPath::kElementLineto)
+      continue;
+    minlon = (empty ? element.itsX : std::min(minlon, element.itsX));
+    minlat = (empty ? element.itsY : std::min(minlat, element.itsY));
+    maxlon = (empty ? element.itsX : std::max(maxlon, element.itsX));
+    maxlat = (empty ? element.itsY : std::max(maxlat, element.itsY));
+    empty = false;
+  }
+  if (empty)
+    return 1;
+  return estimate_area_points(minlon, minlat, maxlon, maxlat, theRadius, theResolution);
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Quick check on request limits
@@ -335,6 +478,98 @@ void check_limits(const Spine::TaggedLocationList& locations, const TS::RequestL
 
 }  // namespace
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Cheap upper estimate of the number of values in the result
+ *
+ * No data is accessed. Data levels are counted only if listed, time steps
+ * of the data are assumed to be 10 minutes apart unless their number is
+ * given, and areas are charged by the grid points of their bounding box
+ * at the admission.grid_resolution. Keyword locations and station
+ * identifiers are part of the location options, and are charged as points.
+ * Bounding boxes are charged by their grid points even when stations are
+ * searched, which is an upper estimate. Requests whose cost cannot be
+ * estimated at all, such as unknown location types, are considered
+ * expensive.
+ */
+// ----------------------------------------------------------------------
+
+std::size_t Plugin::estimateCost(const State& state, const Query& q) const
+{
+  const std::size_t unknown = std::numeric_limits<std::size_t>::max();
+
+  try
+  {
+    const double resolution = itsConfig.admissionGridResolution();
+
+    std::size_t points = 0;
+    for (const auto& tloc : q.loptions->locations())
+    {
+      const auto& loc = tloc.loc;
+      switch (loc->type)
+      {
+        case Spine::Location::Place:
+        case Spine::Location::CoordinatePoint:
+          if (loc->radius == 0)
+            points += 1;
+          else
+            points += estimate_area_points(loc->longitude,
+                                           loc->latitude,
+                                           loc->longitude,
+                                           loc->latitude,
+                                           loc->radius,
+                                           resolution);
+          break;
+        case Spine::Location::BoundingBox:
+        {
+          Spine::BoundingBox bbox(get_name_base(loc->name));
+          points += estimate_area_points(
+              bbox.xMin, bbox.yMin, bbox.xMax, bbox.yMax, loc->radius, resolution);
+          break;
+        }
+        case Spine::Location::Wkt:
+          points += estimate_area_points(
+              q.wktGeometries.getSvgPath(loc->name), loc->radius, resolution);
+          break;
+        case Spine::Location::Area:
+        case Spine::Location::Path:
+          points += estimate_area_points(
+              *get_svg_path(tloc, itsGeometryStorage, itsGeometryCache.get()),
+              loc->radius,
+              resolution);
+          break;
+        default:
+          return unknown;
+      }
+    }
+
+    std::size_t timesteps = 0;
+    if (!q.toptions.all())
+    {
+      auto tz = state.getTimeZone(q.timezone == LOCALTIME_PARAM ? "UTC" : q.timezone);
+      timesteps = itsTimeSeriesCache->generate(q.toptions, tz)->size();
+    }
+    else if (q.toptions.timeSteps && *q.toptions.timeSteps > 0)
+      timesteps = *q.toptions.timeSteps;
+    else
+    {
+      const long seconds = (q.toptions.endTime - q.toptions.startTime).total_seconds();
+      timesteps = std::max(seconds, 0L) / 600 + 1;
+    }
+
+    const std::size_t nparams = q.poptions.parameterFunctions().size();
+    const std::size_t nlevels =
+        std::max<std::size_t>(q.levels.size() + q.pressures.size() + q.heights.size(), 1);
+    const std::size_t ngroups = std::max<std::size_t>(q.timeproducers.size(), 1);
+
+    return ngroups * nparams * nlevels * timesteps * points;
+  }
+  catch (...)
+  {
+    return unknown;
+  }
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Perform a TimeSeries query
@@ -355,9 +590,12 @@ void Plugin::query(const State& state,
 
     // Options
     high_resolution_clock::time_point t1 = high_resolution_clock::now();
+    std::optional<TraceSpan> span;
+    span.emplace(state, "parse");
     Query q(state, request, itsConfig);
 
     // Resolve locations for FMISDs,WMOs,LPNNs (https://jira.fmi.fi/browse/BRAINSTORM-1848)
+    span.emplace(state, "locations");
     Engine::Geonames::LocationOptions lopt =
         itsEngines.geoEngine->parseLocations(q.fmisids, q.lpnns, q.wmos, q.language);
 
@@ -365,6 +603,7 @@ void Plugin::query(const State& state,
     Spine::TaggedLocationList tagged_ll = q.loptions->locations();
     tagged_ll.insert(tagged_ll.end(), locations.begin(), locations.end());
     q.loptions->setLocations(tagged_ll);
+    span.reset();
 
     check_limits(locations, itsConfig.requestLimits());
 
@@ -391,58 +630,104 @@ void Plugin::query(const State& state,
     // The formatter knows which mimetype to send
     Spine::TableFormatter* fmt = get_formatter_and_qstreamer(q, queryStreamer);
 
-#if 0
-    bool gridEnabled = false;
-    if (strcasecmp(q.forecastSource.c_str(), "grid") == 0 ||
-        (q.forecastSource.length() == 0 &&
-         strcasecmp(itsConfig.primaryForecastSource().c_str(), "grid") == 0))
-      gridEnabled = true;
-#endif
-
     std::shared_ptr<Spine::TableFormatter> formatter(fmt);
     std::string mime = formatter->mimetype() + "; charset=UTF-8";
     response.setHeader("Content-Type", mime);
 
-    // Calculate the hash value for the product.
+    // Calculate the hash value for the product before fetching any data. It is the ETag
+    // of every response for the product, hence ETag probes and revalidations can be
+    // answered cheaply. Products which cannot be hashed, such as observations and grid
+    // data, get an ETag based on the content. Streamed grid files are never cached.
 
     std::size_t product_hash = Fmi::bad_hash;
 
     QueryProcessingHub qph(*this);
-/*
-    try
+
+    // Output the execution plan instead of the data
+    if (strcasecmp(q.format.c_str(), "EXPLAIN") == 0)
     {
-      product_hash = qph.hash_value(state, request, q);
+      Spine::TableFormatter::Names headers;
+      qph.explainQuery(state, q).fill_table(data, headers);
+      auto out = formatter->format(data, headers, request, itsConfig.formatterOptions());
+      response.setHeader("X-TimeSeries-Cache", "no");
+      response.setContent(out);
+      return;
     }
-    catch (...)
+
+    if (!queryStreamer)
     {
-      if (!gridEnabled)
-        throw Fmi::Exception::Trace(BCP, "Operation failed!");
+      try
+      {
+        TraceSpan hash_span(state, "hash");
+        product_hash = qph.hash_value(state, request, q);
+      }
+      catch (...)
+      {
+        // Not cacheable, any real errors will be reported when the query is processed
+        product_hash = Fmi::bad_hash;
+      }
     }
-*/
+
     high_resolution_clock::time_point t3 = high_resolution_clock::now();
 
     std::string timeheader = Fmi::to_string(duration_cast<microseconds>(t2 - t1).count()) + '+' +
                              Fmi::to_string(duration_cast<microseconds>(t3 - t2).count());
 
-    //if (etag_only(request, response, product_hash))
-    //  return;
+    if (etag_only(request, response, product_hash))
+      return;
 
-    // If obj is not nullptr it is from cache
-    auto obj = qph.processQuery(state, data, q, queryStreamer, product_hash);
+    if (product_hash != Fmi::bad_hash && itsCache)
+    {
+      auto obj = itsCache->find(product_hash);
+      if (obj)
+      {
+        response.setHeader("X-Duration", timeheader);
+        response.setHeader("X-TimeSeries-Cache", "yes");
+        response.setContent(*obj);
+        return;
+      }
+    }
 
-    if (obj)
+    // Identical concurrent requests wait for the first one to finish and share its
+    // output or its rejection. If the wait times out the product is generated
+    // independently.
+    std::unique_ptr<InFlightRequests::Leader> leader;
+    if (itsInFlightRequests && product_hash != Fmi::bad_hash)
     {
-      product_hash = Fmi::hash_value(*obj);
-      if (etag_only(request, response, product_hash))
+      std::shared_ptr<std::string> shared;
+      bool rejected = false;
+      leader = itsInFlightRequests->join(product_hash, request_key(request), shared, rejected);
+      if (rejected)
+      {
+        reject_busy(response, itsConfig.admissionRetryAfter());
         return;
+      }
+      if (shared)
+      {
+        response.setHeader("X-Duration", timeheader);
+        response.setHeader("X-TimeSeries-Cache", "shared");
+        response.setContent(shared);
+        return;
+      }
+    }
 
-      response.setHeader("X-Duration", timeheader);
-      response.setHeader("X-TimeSeries-Cache", "yes");
-      response.setContent(obj);
-      return;
+    // Expensive requests may run only a limited number at a time
+    std::unique_ptr<AdmissionControl::Slot> admission;
+    if (itsAdmissionControl && estimateCost(state, q) > itsConfig.admissionCostLimit())
+    {
+      admission = itsAdmissionControl->admit();
+      if (!admission)
+      {
+        if (leader)
+          leader->reject();
+        reject_busy(response, itsConfig.admissionRetryAfter());
+        return;
+      }
     }
 
     // Must generate the result from scratch
+    qph.processQuery(state, data, q, queryStreamer, product_hash);
+
     response.setHeader("X-TimeSeries-Cache", "no");
 
     high_resolution_clock::time_point t4 = high_resolution_clock::now();
@@ -463,7 +748,9 @@ void Plugin::query(const State& state,
     auto formatter_options = itsConfig.formatterOptions();
     formatter_options.setFormatType(wxml_type);
 
+    span.emplace(state, "format");
     auto out = formatter->format(data, headers, request, formatter_options);
+    span.reset();
     high_resolution_clock::time_point t5 = high_resolution_clock::now();
     timeheader.append("+").append(
         Fmi::to_string(std::chrono::duration_cast<std::chrono::microseconds>(t5 - t4).count()));
@@ -497,11 +784,23 @@ void Plugin::query(const State& state,
     }
     else
     {
-      product_hash = Fmi::hash_value(*result);
-      if (etag_only(request, response, product_hash))
-        return;
+      // Products which were not hashed in advance get an ETag based on the content
+      if (product_hash != Fmi::bad_hash)
+      {
+        if (itsCache)
+          itsCache->insert(product_hash, result);
+        if (leader)
+          leader->publish(result);
+      }
+      else
+      {
+        product_hash = Fmi::hash_value(*result);
+        if (etag_only(request, response, product_hash))
+          return;
+      }
 
-      response.setContent(*result);
+      // Share the formatted output instead of copying it into the response
+      response.setContent(result);
     }
   }
   catch (...)
@@ -570,8 +869,10 @@ void Plugin::requestHandler(Spine::Reactor& /* theReactor */,
                             const Spine::HTTP::Request& theRequest,
                             Spine::HTTP::Response& theResponse)
 {
-  // We need this in the catch block
+  // We need these in the catch block
   bool isdebug = false;
+  std::optional<State> state;
+  bool traced = false;
 
   try
   {
@@ -583,11 +884,23 @@ void Plugin::requestHandler(Spine::Reactor& /* theReactor */,
     theResponse.setHeader("Access-Control-Allow-Origin", "*");
 
     auto expires_seconds = itsConfig.expirationTime();
-    State state(*this);
+    state.emplace(*this);
 
     theResponse.setStatus(Spine::HTTP::Status::ok);
 
-    query(state, theRequest, theResponse);  // may modify the status
+    query(*state, theRequest, theResponse);  // may modify the status
+
+    traced = true;
+    itsStageStatistics.record(state->getTrace());
+    if (Spine::optional_bool(theRequest.getParameter("debug"), false))
+      theResponse.setHeader("X-Trace", state->getTrace().header());
+
+    // Rejected requests must not be cached
+    if (theResponse.getStatus() == Spine::HTTP::Status::service_unavailable)
+    {
+      theResponse.setHeader("Cache-Control", "no-cache, must-revalidate");
+      return;
+    }
 
     // Adding response headers
 
@@ -603,12 +916,12 @@ void Plugin::requestHandler(Spine::Reactor& /* theReactor */,
       std::string cachecontrol = "public, max-age=" + Fmi::to_string(expires_seconds);
       theResponse.setHeader("Cache-Control", cachecontrol);
 
-      Fmi::DateTime t_expires = state.getTime() + Fmi::Seconds(expires_seconds);
+      Fmi::DateTime t_expires = state->getTime() + Fmi::Seconds(expires_seconds);
       std::string expiration = tformat->format(t_expires);
       theResponse.setHeader("Expires", expiration);
     }
 
-    std::string modification = tformat->format(state.getTime());
+    std::string modification = tformat->format(state->getTime());
     theResponse.setHeader("Last-Modified", modification);
   }
   catch (...)
@@ -653,6 +966,21 @@ void Plugin::requestHandler(Spine::Reactor& /* theReactor */,
     if (firstMessage.size() > 300)
       firstMessage.resize(300);
     theResponse.setHeader("X-TimeSeriesPlugin-Error", firstMessage);
+
+    // The stages of failed requests are traced too
+    if (state && !traced)
+    {
+      try
+      {
+        itsStageStatistics.record(state->getTrace());
+        if (Spine::optional_bool(theRequest.getParameter("debug"), false))
+          theResponse.setHeader("X-Trace", state->getTrace().header());
+      }
+      catch (...)
+      {
+        // The error has already been reported
+      }
+    }
   }
 }
 
@@ -695,6 +1023,45 @@ void Plugin::init()
     itsTimeSeriesCache.reset(new TS::TimeSeriesGeneratorCache);
     itsTimeSeriesCache->resize(itsConfig.maxTimeSeriesCacheSize());
 
+    // Point forecast cache
+    if (itsConfig.maxPointValueCacheSize() > 0)
+      itsPointValueCache.reset(new PointValueCache(itsConfig.maxPointValueCacheSize()));
+
+    // Index mask cache
+    if (itsConfig.maxIndexMaskCacheSize() > 0)
+      itsIndexMaskCache.reset(new IndexMaskCache(itsConfig.maxIndexMaskCacheSize()));
+
+    // DEM and land cover cache for grid points
+    if (itsConfig.maxLandscapeCacheSize() > 0)
+      itsLandscapeCache.reset(new LandscapeCache(itsConfig.maxLandscapeCacheSize()));
+
+    // Parsed and expanded geometries
+    if (itsConfig.maxGeometryCacheSize() > 0)
+      itsGeometryCache.reset(new GeometryCache(itsConfig.maxGeometryCacheSize()));
+
+    // Product cache
+    if (itsConfig.maxMemoryCacheSize() > 0)
+      itsCache.reset(new Spine::SmartMetCache(itsConfig.maxMemoryCacheSize(),
+                                              itsConfig.maxFilesystemCacheSize(),
+                                              itsConfig.filesystemCacheDirectory()));
+
+    // Threads for processing the locations and grid queries of requests in parallel
+    if (itsConfig.maxRequestThreads() > 1 && itsConfig.taskPoolThreads() > 0)
+      itsTaskPool.reset(
+          new TaskPool(itsConfig.taskPoolThreads(), 4 * itsConfig.taskPoolThreads()));
+
+    // Admission control of expensive requests
+    if (itsConfig.admissionCostLimit() > 0)
+      itsAdmissionControl.reset(
+          new AdmissionControl(itsConfig.admissionMaxActive(),
+                               itsConfig.admissionMaxQueued(),
+                               std::chrono::milliseconds(itsConfig.admissionMaxWait())));
+
+    // Coalescing of identical concurrent requests
+    if (itsConfig.coalesceMaxWait() > 0)
+      itsInFlightRequests.reset(
+          new InFlightRequests(std::chrono::milliseconds(itsConfig.coalesceMaxWait())));
+
     /* GeoEngine */
     itsEngines.geoEngine = itsReactor->getEngine<Engine::Geonames::Engine>("Geonames", nullptr);
 
@@ -781,6 +1148,16 @@ void Plugin::init()
         },
         "List available time parameters");
 
+    itsReactor->addAdminTableRequestHandler(
+        this,
+        "stagelatencies",
+        AdminRequestAccess::Public,
+        [this] (Spine::Reactor& theReactor, const Spine::HTTP::Request& theRequest) -> std::unique_ptr<Spine::Table>
+        {
+          return itsStageStatistics.table();
+        },
+        "Latency histograms of the request processing stages");
+
     // DEPRECATED:
 
     if (!itsReactor->addContentHandler(this,
@@ -865,6 +1242,31 @@ Fmi::Cache::CacheStatistics Plugin::getCacheStats() const
   ret.insert(std::make_pair("Timeseries::timeseries_generator_cache",
                             itsTimeSeriesCache->getCacheStats()));
 
+  if (itsPointValueCache)
+    ret.insert(std::make_pair("Timeseries::point_value_cache", itsPointValueCache->statistics()));
+
+  if (itsIndexMaskCache)
+    ret.insert(std::make_pair("Timeseries::indexmask_cache", itsIndexMaskCache->statistics()));
+
+  if (itsLandscapeCache)
+    ret.insert(std::make_pair("Timeseries::landscape_cache", itsLandscapeCache->getCacheStats()));
+
+  if (itsGeometryCache)
+  {
+    ret.insert(
+        std::make_pair("Timeseries::svg_path_cache", itsGeometryCache->svgPaths.statistics()));
+    ret.insert(std::make_pair("Timeseries::ogr_geometry_cache",
+                              itsGeometryCache->ogrGeometries.statistics()));
+  }
+
+  if (itsCache)
+  {
+    ret.insert(std::make_pair("Timeseries::product_memory_cache",
+                              itsCache->getMemoryCacheStats()));
+    ret.insert(std::make_pair("Timeseries::product_filesystem_cache",
+                              itsCache->getFileCacheStats()));
+  }
+
   return ret;
 }
 
@@ -6,8 +6,17 @@
 
 #pragma once
 
+#include "AdmissionControl.h"
+#include "InFlightRequests.h"
+#include "Tracing.h"
 #include "Config.h"
 #include "Engines.h"
+#include "GeometryCache.h"
+#include "IndexMaskCache.h"
+#include "LandscapeCache.h"
+#include "PointValueCache.h"
+#include "TaskPool.h"
+#include <spine/SmartMetCache.h>
 
 namespace SmartMet
 {
@@ -36,6 +45,7 @@ namespace Plugin
 namespace TimeSeries
 {
 class State;
+struct Query;
 class PluginImpl;
 
 class Plugin : public SmartMetPlugin
@@ -71,6 +81,8 @@ class Plugin : public SmartMetPlugin
              const Spine::HTTP::Request& req,
              Spine::HTTP::Response& response);
 
+  std::size_t estimateCost(const State& theState, const Query& theQuery) const;
+
   Fmi::Cache::CacheStatistics getCacheStats() const override;
 
   void grouplocations(Spine::HTTP::Request& theRequest);
@@ -90,6 +102,34 @@ class Plugin : public SmartMetPlugin
   // Cached time series
   mutable std::unique_ptr<TS::TimeSeriesGeneratorCache> itsTimeSeriesCache;
 
+  // Cached point forecasts, enabled only if cache.point_values_size > 0
+  mutable std::unique_ptr<PointValueCache> itsPointValueCache;
+
+  // Cached index masks for areas, enabled only if cache.indexmask_size > 0
+  mutable std::unique_ptr<IndexMaskCache> itsIndexMaskCache;
+
+  // DEM heights and cover types of grid points, enabled only if cache.landscape_points > 0
+  mutable std::unique_ptr<LandscapeCache> itsLandscapeCache;
+
+  // Parsed SVG paths and expanded WKT geometries, enabled only if cache.geometry_size > 0
+  mutable std::unique_ptr<GeometryCache> itsGeometryCache;
+
+  // Cached final products, enabled only if cache.memory_bytes > 0
+  mutable std::unique_ptr<Spine::SmartMetCache> itsCache;
+
+  // Threads shared by the parallel parts of all requests, enabled only if
+  // max_request_threads > 1 and task_pool_threads > 0
+  std::unique_ptr<TaskPool> itsTaskPool;
+
+  // Limits concurrent expensive requests, enabled only if admission.cost_limit > 0
+  std::unique_ptr<AdmissionControl> itsAdmissionControl;
+
+  // Identical concurrent requests share one output, enabled only if coalesce.max_wait > 0
+  std::unique_ptr<InFlightRequests> itsInFlightRequests;
+
+  // Latencies of the request processing stages for the admin interface
+  StageStatistics itsStageStatistics;
+
   // Geometries and their svg-representations are stored here
   Engine::Gis::GeometryStorage itsGeometryStorage;
 
@@ -0,0 +1,76 @@
+// ======================================================================
+/*!
+ * \brief Process wide cache for interpolated point time series.
+ *
+ * The cache is indexed by a hash of the key, but the full key is stored
+ * with the values and compared on every hit so that a hash collision can
+ * never return the values of another point or parameter. The key
+ * includes the querydata hash value and origin time, hence results for
+ * an old model run are never found once the querydata engine has loaded
+ * a new one, and the obsolete entries simply age out of the LRU cache.
+ *
+ */
+// ======================================================================
+
+#pragma once
+
+#include <macgyver/Cache.h>
+#include <macgyver/DateTime.h>
+#include <newbase/NFmiPoint.h>
+#include <timeseries/TimeSeriesInclude.h>
+#include <optional>
+#include <string>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace TimeSeries
+{
+struct PointValueKey
+{
+  std::size_t querydata = 0;  // hash value of the querydata
+  std::string producer;
+  Fmi::DateTime origintime;
+  std::string parameter;
+  double longitude = 0;
+  double latitude = 0;
+  double dem = 0;
+  int covertype = 0;
+  double maxdistance = 0;
+  bool findnearestvalidpoint = false;
+  std::string timezone;
+  float level = 0;
+  std::string levelname;
+  bool loaddatalevels = false;
+  std::optional<float> pressure;
+  std::optional<float> height;
+  std::size_t timesteps = 0;  // hash value of the local times
+
+  bool operator==(const PointValueKey& other) const
+  {
+    return (querydata == other.querydata && producer == other.producer &&
+            origintime == other.origintime && parameter == other.parameter &&
+            longitude == other.longitude && latitude == other.latitude && dem == other.dem &&
+            covertype == other.covertype && maxdistance == other.maxdistance &&
+            findnearestvalidpoint == other.findnearestvalidpoint && timezone == other.timezone &&
+            level == other.level && levelname == other.levelname &&
+            loaddatalevels == other.loaddatalevels && pressure == other.pressure &&
+            height == other.height && timesteps == other.timesteps);
+  }
+};
+
+struct PointValues
+{
+  PointValueKey key;
+  // The values are shared and must never be modified
+  std::shared_ptr<const TS::TimeSeries> values;
+  // The point actually used for the interpolation
+  NFmiPoint lastpoint;
+};
+
+using PointValueCache = Fmi::Cache::Cache<std::size_t, std::shared_ptr<const PointValues>>;
+
+}  // namespace TimeSeries
+}  // namespace Plugin
+}  // namespace SmartMet
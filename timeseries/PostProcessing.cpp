@@ -3,6 +3,9 @@
 #include "UtilityFunctions.h"
 #include <timeseries/ParameterKeywords.h>
 #include <timeseries/TableFeeder.h>
+#include <iterator>
+#include <map>
+#include <memory>
 
 namespace SmartMet
 {
@@ -80,8 +83,11 @@ void update_latest_timestep(Query& query, const TS::TimeSeriesGroup& tsg)
 {
   try
   {
+    if (tsg.empty())
+      return;
+
     // take first time series and last timestep thereof
-    TS::TimeSeries ts = tsg[0].timeseries;
+    const TS::TimeSeries& ts = tsg[0].timeseries;
 
     if (ts.empty())
       return;
@@ -95,23 +101,58 @@ void update_latest_timestep(Query& query, const TS::TimeSeriesGroup& tsg)
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Count the values in the data
+ */
+// ----------------------------------------------------------------------
+
+std::size_t number_of_elements(const TS::TimeSeriesData& tsdata)
+{
+  try
+  {
+    if (const auto* ts = std::get_if<TS::TimeSeriesPtr>(&tsdata))
+      return (*ts)->size();
+
+    std::size_t count = 0;
+    if (const auto* tsv = std::get_if<TS::TimeSeriesVectorPtr>(&tsdata))
+    {
+      for (const auto& ts : **tsv)
+        count += ts.size();
+    }
+    else if (const auto* tsg = std::get_if<TS::TimeSeriesGroupPtr>(&tsdata))
+    {
+      for (const auto& llts : **tsg)
+        count += llts.timeseries.size();
+    }
+    return count;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief
  */
 // ----------------------------------------------------------------------
 
-void store_data(TS::TimeSeriesVectorPtr aggregatedData, Query& query, TS::OutputData& outputData)
+std::size_t store_data(TS::TimeSeriesVectorPtr aggregatedData,
+                       Query& query,
+                       TS::OutputData& outputData)
 {
   try
   {
     if (aggregatedData->empty())
-      return;
+      return 0;
 
     // insert data to the end
     std::vector<TS::TimeSeriesData>& odata = (--outputData.end())->second;
     odata.emplace_back(TS::TimeSeriesData(aggregatedData));
     update_latest_timestep(query, aggregatedData);
+    return number_of_elements(odata.back());
   }
   catch (...)
   {
@@ -119,53 +160,86 @@ void store_data(TS::TimeSeriesVectorPtr aggregatedData, Query& query, TS::Output
   }
 }
 
+namespace
+{
 // ----------------------------------------------------------------------
 /*!
- * \brief
+ * \brief Concatenate the levels of one parameter
+ *
+ * A single level is passed on as is. Otherwise the result is reserved in
+ * one go, and elements are moved out of series nobody else refers to.
+ * Aggregation may return its input unchanged, and that may still be
+ * referenced by the level data cache.
  */
 // ----------------------------------------------------------------------
 
-void store_data(std::vector<TS::TimeSeriesData>& aggregatedData,
-                Query& query,
-                TS::OutputData& outputData)
+template <typename T>
+std::shared_ptr<T> merge_levels(const std::vector<TS::TimeSeriesData>& aggregatedData)
+{
+  if (aggregatedData.size() == 1)
+    return std::get<std::shared_ptr<T>>(aggregatedData[0]);
+
+  std::size_t total = 0;
+  for (const auto& data : aggregatedData)
+    total += std::get<std::shared_ptr<T>>(data)->size();
+
+  auto result = std::make_shared<T>();
+  result->reserve(total);
+
+  for (const auto& data : aggregatedData)
+  {
+    const auto& part = std::get<std::shared_ptr<T>>(data);
+    if (part.use_count() == 1)
+      result->insert(result->end(),
+                     std::make_move_iterator(part->begin()),
+                     std::make_move_iterator(part->end()));
+    else
+      result->insert(result->end(), part->begin(), part->end());
+  }
+  return result;
+}
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Store the data of all levels of one parameter as one column
+ */
+// ----------------------------------------------------------------------
+
+std::size_t store_data(std::vector<TS::TimeSeriesData>& aggregatedData,
+                       Query& query,
+                       TS::OutputData& outputData)
 {
   try
   {
     if (aggregatedData.empty())
-      return;
+      return 0;
 
     TS::TimeSeriesData tsdata;
-    if (const auto* ptr = std::get_if<TS::TimeSeriesPtr>(aggregatedData.data()))
+    if (std::get_if<TS::TimeSeriesPtr>(aggregatedData.data()))
     {
-      TS::TimeSeriesPtr ts_first = *ptr;
-      TS::TimeSeriesPtr ts_result(new TS::TimeSeries);
       // first merge timeseries of all levels of one parameter
-      for (const auto& data : aggregatedData)
-      {
-        TS::TimeSeriesPtr ts = std::get<TS::TimeSeriesPtr>(data);
-        ts_result->insert(ts_result->end(), ts->begin(), ts->end());
-      }
+      auto ts_result = merge_levels<TS::TimeSeries>(aggregatedData);
       // update the latest timestep, so that next query (if exists) knows from where to continue
       update_latest_timestep(query, *ts_result);
-      tsdata = ts_result;
+      tsdata = std::move(ts_result);
     }
     else if (std::get_if<TS::TimeSeriesGroupPtr>(aggregatedData.data()))
     {
-      TS::TimeSeriesGroupPtr tsg_result(new TS::TimeSeriesGroup);
       // first merge timeseries of all levels of one parameter
-      for (const auto& data : aggregatedData)
-      {
-        TS::TimeSeriesGroupPtr tsg = *(std::get_if<TS::TimeSeriesGroupPtr>(&data));
-        tsg_result->insert(tsg_result->end(), tsg->begin(), tsg->end());
-      }
+      auto tsg_result = merge_levels<TS::TimeSeriesGroup>(aggregatedData);
       // update the latest timestep, so that next query (if exists) knows from where to continue
       update_latest_timestep(query, *tsg_result);
-      tsdata = tsg_result;
+      tsdata = std::move(tsg_result);
     }
 
+    // the levels are no longer needed separately
+    aggregatedData.clear();
+
     // insert data to the end
     std::vector<TS::TimeSeriesData>& odata = (--outputData.end())->second;
-    odata.push_back(tsdata);
+    odata.push_back(std::move(tsdata));
+    return number_of_elements(odata.back());
   }
   catch (...)
   {
@@ -256,7 +330,7 @@ void fill_table(Query& query, TS::OutputData& outputData, Spine::Table& table)
     std::string locationName(outputData[0].first);
 
     // At first check whether observations exist and put them at begin of result set when found
-    TS::OutputData::const_iterator it = outputData.begin();
+    auto it = outputData.begin();
     if (it->first == "_obs_")
     {
       add_data_to_table(query.poptions.parameters(), tf, it->second, startRow);
@@ -264,20 +338,31 @@ void fill_table(Query& query, TS::OutputData& outputData, Spine::Table& table)
     }
 
     // Make index for locations to speed up the search (exclude observations when found from index)
-    std::multimap<std::string, TS::OutputData::const_iterator> locationIndex;
+    std::multimap<std::string, TS::OutputData::iterator> locationIndex;
     for (; it != outputData.end(); ++it)
     {
       locationIndex.emplace(it->first, it);
     }
 
+    // The same location may be requested several times. Count the uses so that
+    // the data of each location can be released once it has been written for
+    // the last time, and the table and the data do not both peak at full size.
+    std::map<std::string, std::size_t> remainingUses;
+    for (const auto& tloc : query.loptions->locations())
+      ++remainingUses[get_location_id(tloc.loc)];
+
     // iterate locations
     for (const auto& tloc : query.loptions->locations())
     {
       std::string locationId = get_location_id(tloc.loc);
       auto range = locationIndex.equal_range(locationId);
+      const bool lastUse = (--remainingUses[locationId] == 0);
       for (auto it = range.first; it != range.second; ++it)
       {
-        add_data_to_table(query.poptions.parameters(), tf, it->second->second, startRow);
+        auto& outdata = it->second->second;
+        add_data_to_table(query.poptions.parameters(), tf, outdata, startRow);
+        if (lastUse)
+          std::vector<TS::TimeSeriesData>().swap(outdata);
       }
     }
   }
@@ -18,10 +18,14 @@ namespace TimeSeries
 {
 namespace PostProcessing
 {
-void store_data(TS::TimeSeriesVectorPtr aggregatedData, Query& query, TS::OutputData& outputData);
-void store_data(std::vector<TS::TimeSeriesData>& aggregatedData,
-                Query& query,
-                TS::OutputData& outputData);
+// The store functions return the number of stored elements for request limit checks
+std::size_t number_of_elements(const TS::TimeSeriesData& tsdata);
+std::size_t store_data(TS::TimeSeriesVectorPtr aggregatedData,
+                       Query& query,
+                       TS::OutputData& outputData);
+std::size_t store_data(std::vector<TS::TimeSeriesData>& aggregatedData,
+                       Query& query,
+                       TS::OutputData& outputData);
 void fill_table(Query& query, TS::OutputData& outputData, Spine::Table& table);
 void fix_precisions(Query& masterquery, const ObsParameters& obsParameters);
 }  // namespace PostProcessing
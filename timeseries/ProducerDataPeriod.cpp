@@ -21,14 +21,14 @@ namespace TimeSeries
 {
 Fmi::LocalDateTime ProducerDataPeriod::getTime(const std::string& producer,
                                                                const std::string& timezone,
-                                                               const Fmi::TimeZones& timezones,
+                                                               const State& state,
                                                                eTime time_enum) const
 {
   try
   {
     try
     {
-      Fmi::TimeZonePtr tz = timezones.time_zone_from_string(timezone);
+      Fmi::TimeZonePtr tz = state.getTimeZone(timezone);
 
       if (itsDataPeriod.find(producer) == itsDataPeriod.end())
           return Fmi::LocalDateTime(Fmi::LocalDateTime::NOT_A_DATE_TIME, tz);
@@ -121,11 +121,11 @@ void ProducerDataPeriod::getObsEngineDataPeriods(const Engine::Observation::Engi
 
 // localtime
 Fmi::LocalDateTime ProducerDataPeriod::getLocalStartTime(
-    const std::string& producer, const std::string& timezone, const Fmi::TimeZones& timezones) const
+    const std::string& producer, const std::string& timezone, const State& state) const
 {
   try
   {
-    return getTime(producer, timezone, timezones, STARTTIME);
+    return getTime(producer, timezone, state, STARTTIME);
   }
   catch (...)
   {
@@ -148,11 +148,11 @@ Fmi::DateTime ProducerDataPeriod::getUTCStartTime(const std::string& producer) c
 
 // localtime
 Fmi::LocalDateTime ProducerDataPeriod::getLocalEndTime(
-    const std::string& producer, const std::string& timezone, const Fmi::TimeZones& timezones) const
+    const std::string& producer, const std::string& timezone, const State& state) const
 {
   try
   {
-    return getTime(producer, timezone, timezones, ENDTIME);
+    return getTime(producer, timezone, state, ENDTIME);
   }
   catch (...)
   {
@@ -182,6 +182,7 @@ void ProducerDataPeriod::init(const State& state,
 {
   try
   {
+    TraceSpan span(state, "data_periods");
     itsDataPeriod.clear();
     getQEngineDataPeriods(querydata, producers);
 #ifndef WITHOUT_OBSERVATION
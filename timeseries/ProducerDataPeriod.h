@@ -42,7 +42,7 @@ class ProducerDataPeriod
 
   Fmi::LocalDateTime getTime(const std::string& producer,
                                              const std::string& timezone,
-                                             const Fmi::TimeZones& timezones,
+                                             const State& state,
                                              eTime time_enum) const;
 
   Fmi::DateTime getTime(const std::string& producer, eTime time_enum) const;
@@ -59,13 +59,13 @@ class ProducerDataPeriod
  public:
   Fmi::LocalDateTime getLocalStartTime(const std::string& producer,
                                                        const std::string& timezone,
-                                                       const Fmi::TimeZones& timezones) const;
+                                                       const State& state) const;
 
   Fmi::DateTime getUTCStartTime(const std::string& producer) const;
 
   Fmi::LocalDateTime getLocalEndTime(const std::string& producer,
                                                      const std::string& timezone,
-                                                     const Fmi::TimeZones& timezones) const;
+                                                     const State& state) const;
 
   Fmi::DateTime getUTCEndTime(const std::string& producer) const;
 
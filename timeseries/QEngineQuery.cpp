@@ -1,9 +1,11 @@
 #include "QEngineQuery.h"
 #include "LocationTools.h"
+#include "ParallelTasks.h"
 #include "PostProcessing.h"
 #include "State.h"
 #include "UtilityFunctions.h"
 #include <macgyver/Exception.h>
+#include <macgyver/Hash.h>
 #include <newbase/NFmiIndexMaskTools.h>
 #include <newbase/NFmiLocation.h>
 #include <newbase/NFmiSvgTools.h>
@@ -12,6 +14,9 @@
 #include <timeseries/TableFeeder.h>
 #include <timeseries/TimeSeriesInclude.h>
 #include <timeseries/TimeSeriesOutput.h>
+#include <iterator>
+#include <memory>
+#include <optional>
 
 namespace SmartMet
 {
@@ -53,13 +58,13 @@ void require_validtimes(const std::shared_ptr<Engine::Querydata::ValidTimeList>&
   }
 }
 
-bool is_wkt_area(const Spine::LocationPtr& loc)
+bool is_wkt_area(const Spine::LocationPtr& loc, GeometryCache* geometryCache)
 {
   try
   {
     if (loc->type == Spine::Location::Wkt)
     {
-      auto geom = get_ogr_geometry(loc->name, loc->radius);
+      auto geom = get_shared_ogr_geometry(loc->name, loc->radius, geometryCache);
 
       if (!geom)
         return false;
@@ -77,7 +82,7 @@ bool is_wkt_area(const Spine::LocationPtr& loc)
   }
 }
 
-bool is_point_query(const Spine::LocationPtr& loc)
+bool is_point_query(const Spine::LocationPtr& loc, GeometryCache* geometryCache)
 {
   try
   {
@@ -87,7 +92,7 @@ bool is_point_query(const Spine::LocationPtr& loc)
 
     if (loc->type == Spine::Location::Wkt)
     {
-      auto geom = get_ogr_geometry(loc->name, loc->radius);
+      auto geom = get_shared_ogr_geometry(loc->name, loc->radius, geometryCache);
       return (geom && geom->getGeometryType() == wkbPoint);
     }
     return false;
@@ -98,26 +103,60 @@ bool is_point_query(const Spine::LocationPtr& loc)
   }
 }
 
-Spine::LocationList get_indexmask_locations(const NFmiIndexMask& indexmask,
+// DEM heights and cover types for the mask, from the shared arrays if enabled
+std::vector<Landscape> get_landscapes(const NFmiIndexMask& indexmask,
+                                      const Engine::Querydata::Q& qi,
+                                      const Engine::Geonames::Engine& geoengine,
+                                      LandscapeCache* landscapeCache)
+{
+  try
+  {
+    if (landscapeCache)
+      return landscapeCache->get(indexmask, qi, geoengine);
+
+    std::vector<Landscape> ret;
+    ret.reserve(indexmask.size());
+    for (const auto& mask : indexmask)
+    {
+      NFmiPoint coord = qi->latLon(mask);
+      Landscape landscape;
+      landscape.dem = geoengine.demHeight(coord.X(), coord.Y());
+      landscape.covertype = geoengine.coverType(coord.X(), coord.Y());
+      ret.push_back(landscape);
+    }
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+Spine::LocationList get_indexmask_locations(const State& state,
+                                            const NFmiIndexMask& indexmask,
                                             const Spine::LocationPtr& loc,
                                             const Engine::Querydata::Q& qi,
-                                            const Engine::Geonames::Engine& geoengine)
+                                            const Engine::Geonames::Engine& geoengine,
+                                            LandscapeCache* landscapeCache)
 {
   try
   {
     Spine::LocationList loclist;
 
+    const auto landscapes = get_landscapes(indexmask, qi, geoengine, landscapeCache);
+
+    std::size_t i = 0;
     for (const auto& mask : indexmask)
     {
       NFmiPoint coord = qi->latLon(mask);
       Spine::Location location(*loc);
       location.longitude = coord.X();
       location.latitude = coord.Y();
-      location.dem = geoengine.demHeight(location.longitude, location.latitude);
-      location.covertype = geoengine.coverType(location.longitude, location.latitude);
+      location.dem = landscapes[i].dem;
+      location.covertype = landscapes[i].covertype;
       location.type = Spine::Location::CoordinatePoint;
-      Spine::LocationPtr locPtr = std::make_shared<Spine::Location>(location);
-      loclist.emplace_back(locPtr);
+      loclist.emplace_back(state.makeLocation(location));
+      ++i;
     }
 
     return loclist;
@@ -128,29 +167,33 @@ Spine::LocationList get_indexmask_locations(const NFmiIndexMask& indexmask,
   }
 }
 
-Spine::TaggedLocationList get_locations_for_area(const NFmiIndexMask& indexmask,
+Spine::TaggedLocationList get_locations_for_area(const State& state,
+                                                 const NFmiIndexMask& indexmask,
                                                  const Spine::TaggedLocation& tloc,
                                                  const Spine::LocationPtr& area_loc,
                                                  const Engine::Querydata::Q& qi,
-                                                 const Engine::Geonames::Engine& geoengine)
+                                                 const Engine::Geonames::Engine& geoengine,
+                                                 LandscapeCache* landscapeCache)
 {
   try
   {
     Spine::TaggedLocationList tloclist;
 
+    const auto landscapes = get_landscapes(indexmask, qi, geoengine, landscapeCache);
+
+    std::size_t i = 0;
     for (const auto& mask : indexmask)
     {
       NFmiPoint coord = qi->latLon(mask);
       Spine::Location location(*area_loc);
       location.longitude = coord.X();
       location.latitude = coord.Y();
-      location.dem = geoengine.demHeight(location.longitude, location.latitude);
-      location.covertype = geoengine.coverType(location.longitude, location.latitude);
+      location.dem = landscapes[i].dem;
+      location.covertype = landscapes[i].covertype;
       location.type = Spine::Location::CoordinatePoint;
       location.radius = 0;
-      Spine::LocationPtr locPtr = std::make_shared<Spine::Location>(location);
-      Spine::TaggedLocation new_tloc(tloc.tag, locPtr);
-      tloclist.emplace_back(new_tloc);
+      tloclist.emplace_back(Spine::TaggedLocation(tloc.tag, state.makeLocation(location)));
+      ++i;
     }
 
     return tloclist;
@@ -161,12 +204,55 @@ Spine::TaggedLocationList get_locations_for_area(const NFmiIndexMask& indexmask,
   }
 }
 
-NFmiIndexMask get_bbox_indexmask(const Spine::LocationPtr& loc, const Engine::Querydata::Q& qi)
+// Expand the path to an index mask, reusing earlier results for the same grid
+std::shared_ptr<const NFmiIndexMask> get_indexmask(const NFmiSvgPath& svgPath,
+                                                   double radius,
+                                                   const Engine::Querydata::Q& qi,
+                                                   IndexMaskCache* maskCache)
 {
   try
   {
-    NFmiIndexMask indexmask;
+    if (!maskCache)
+      return std::make_shared<NFmiIndexMask>(
+          NFmiIndexMaskTools::MaskExpand(qi->grid(), svgPath, radius));
+
+    IndexMaskKey key;
+    key.grid = qi->gridHashValue();
+    key.radius = radius;
+
+    auto hash = key.grid;
+    Fmi::hash_combine(hash, Fmi::hash_value(radius));
+    for (const auto& element : svgPath)
+    {
+      key.path.emplace_back(static_cast<int>(element.itsType), element.itsX, element.itsY);
+      Fmi::hash_combine(hash, Fmi::hash_value(static_cast<int>(element.itsType)));
+      Fmi::hash_combine(hash, Fmi::hash_value(element.itsX));
+      Fmi::hash_combine(hash, Fmi::hash_value(element.itsY));
+    }
+
+    auto cached = maskCache->find(hash);
+    if (cached && (*cached)->key == key)
+      return (*cached)->mask;
+
+    auto entry = std::make_shared<IndexMask>();
+    entry->key = std::move(key);
+    entry->mask = std::make_shared<const NFmiIndexMask>(
+        NFmiIndexMaskTools::MaskExpand(qi->grid(), svgPath, radius));
+    maskCache->insert(hash, entry);
+    return entry->mask;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
+std::shared_ptr<const NFmiIndexMask> get_bbox_indexmask(const Spine::LocationPtr& loc,
+                                                        const Engine::Querydata::Q& qi,
+                                                        IndexMaskCache* maskCache)
+{
+  try
+  {
     std::vector<std::string> coordinates;
     std::string place = get_name_base(loc->name);
     boost::algorithm::split(coordinates, place, boost::algorithm::is_any_of(","));
@@ -190,9 +276,7 @@ NFmiIndexMask get_bbox_indexmask(const Spine::LocationPtr& loc, const Engine::Qu
 
     NFmiSvgPath boundingBoxPath;
     NFmiSvgTools::BBoxToSvgPath(boundingBoxPath, lon1, lat1, lon2, lat2);
-    indexmask = NFmiIndexMaskTools::MaskExpand(qi->grid(), boundingBoxPath, loc->radius);
-
-    return indexmask;
+    return get_indexmask(boundingBoxPath, loc->radius, qi, maskCache);
   }
   catch (...)
   {
@@ -200,21 +284,20 @@ NFmiIndexMask get_bbox_indexmask(const Spine::LocationPtr& loc, const Engine::Qu
   }
 }
 
-NFmiIndexMask get_area_indexmask(const Spine::TaggedLocation& tloc,
-                                 const Spine::LocationPtr& loc,
-                                 const Engine::Querydata::Q& qi,
-                                 const Engine::Gis::GeometryStorage& geometryStorage,
-                                 NFmiSvgPath& svgPath)
+std::shared_ptr<const NFmiIndexMask> get_area_indexmask(
+    const Spine::TaggedLocation& tloc,
+    const Spine::LocationPtr& loc,
+    const Engine::Querydata::Q& qi,
+    const Engine::Gis::GeometryStorage& geometryStorage,
+    GeometryCache* geometryCache,
+    IndexMaskCache* maskCache,
+    std::shared_ptr<const NFmiSvgPath>& svgPath)
 {
   try
   {
-    NFmiIndexMask indexmask;
-
     if (loc->type != Spine::Location::Wkt)  // SVG for WKT has been extracted earlier
-      get_svg_path(tloc, geometryStorage, svgPath);
-    indexmask = NFmiIndexMaskTools::MaskExpand(qi->grid(), svgPath, loc->radius);
-
-    return indexmask;
+      svgPath = get_svg_path(tloc, geometryStorage, geometryCache);
+    return get_indexmask(*svgPath, loc->radius, qi, maskCache);
   }
   catch (...)
   {
@@ -222,29 +305,108 @@ NFmiIndexMask get_area_indexmask(const Spine::TaggedLocation& tloc,
   }
 }
 
-Spine::TaggedLocationList get_tloclist(const Query& query,
+Spine::TaggedLocationList get_tloclist(const State& state,
+                                       const Query& query,
                                        const Spine::TaggedLocation& tloc,
                                        const Spine::LocationPtr& loc,
                                        const Spine::LocationPtr& area_loc,
                                        const Engine::Querydata::Q& qi,
                                        const Engine::Geonames::Engine& geoengine,
                                        const Engine::Gis::GeometryStorage& geometryStorage,
+                                       GeometryCache* geometryCache,
+                                       IndexMaskCache* maskCache,
+                                       LandscapeCache* landscapeCache,
                                        bool bbox_area,
-                                       NFmiSvgPath& svgPath)
+                                       std::shared_ptr<const NFmiSvgPath>& svgPath)
 {
   try
   {
     if (loc->type == Spine::Location::Wkt)
-      svgPath = query.wktGeometries.getSvgPath(tloc.loc->name);
+      svgPath =
+          std::make_shared<const NFmiSvgPath>(query.wktGeometries.getSvgPath(tloc.loc->name));
 
-    NFmiIndexMask indexmask;
+    std::shared_ptr<const NFmiIndexMask> indexmask;
 
     if (bbox_area)
-      indexmask = get_bbox_indexmask(loc, qi);
+      indexmask = get_bbox_indexmask(loc, qi, maskCache);
     else
-      indexmask = get_area_indexmask(tloc, loc, qi, geometryStorage, svgPath);
+      indexmask = get_area_indexmask(
+          tloc, loc, qi, geometryStorage, geometryCache, maskCache, svgPath);
+
+    return get_locations_for_area(
+        state, *indexmask, tloc, area_loc, qi, geoengine, landscapeCache);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// Key for a point forecast in the process wide point value cache
+PointValueKey point_values_key(const Engine::Querydata::Q& qi,
+                               const std::string& producer,
+                               const Spine::Parameter& param,
+                               const Spine::Location& loc,
+                               const Query& query,
+                               const TS::TimeSeriesGenerator::LocalTimeList& tlist,
+                               const std::pair<float, std::string>& cacheKey,
+                               double maxdist,
+                               bool loadDataLevels,
+                               const std::optional<float>& pressure,
+                               const std::optional<float>& height)
+{
+  try
+  {
+    PointValueKey key;
+    key.querydata = Engine::Querydata::hash_value(qi);
+    key.producer = producer;
+    key.origintime = qi->originTime();
+    key.parameter = param.name();
+    key.longitude = loc.longitude;
+    key.latitude = loc.latitude;
+    key.dem = loc.dem;
+    key.covertype = static_cast<int>(loc.covertype);
+    key.maxdistance = maxdist;
+    key.findnearestvalidpoint = query.findnearestvalidpoint;
+    key.timezone = query.timezone;
+    key.level = cacheKey.first;
+    key.levelname = cacheKey.second;
+    key.loaddatalevels = loadDataLevels;
+    key.pressure = pressure;
+    key.height = height;
+    key.timesteps = Fmi::hash_value(tlist);
+    return key;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-    return get_locations_for_area(indexmask, tloc, area_loc, qi, geoengine);
+// Index of the key in the point value cache, the full key is verified on hits
+std::size_t hash_value(const PointValueKey& key)
+{
+  try
+  {
+    auto hash = key.querydata;
+    Fmi::hash_combine(hash, Fmi::hash_value(key.producer));
+    Fmi::hash_combine(hash, Fmi::hash_value(key.parameter));
+    Fmi::hash_combine(hash, Fmi::hash_value(key.longitude));
+    Fmi::hash_combine(hash, Fmi::hash_value(key.latitude));
+    Fmi::hash_combine(hash, Fmi::hash_value(key.dem));
+    Fmi::hash_combine(hash, Fmi::hash_value(key.covertype));
+    Fmi::hash_combine(hash, Fmi::hash_value(key.maxdistance));
+    Fmi::hash_combine(hash, Fmi::hash_value(static_cast<int>(key.findnearestvalidpoint)));
+    Fmi::hash_combine(hash, Fmi::hash_value(key.timezone));
+    Fmi::hash_combine(hash, Fmi::hash_value(static_cast<double>(key.level)));
+    Fmi::hash_combine(hash, Fmi::hash_value(key.levelname));
+    Fmi::hash_combine(hash, Fmi::hash_value(static_cast<int>(key.loaddatalevels)));
+    if (key.pressure)
+      Fmi::hash_combine(hash, Fmi::hash_value(static_cast<double>(*key.pressure)));
+    if (key.height)
+      Fmi::hash_combine(hash, Fmi::hash_value(static_cast<double>(*key.height)));
+    Fmi::hash_combine(hash, key.timesteps);
+    return hash;
   }
   catch (...)
   {
@@ -252,6 +414,25 @@ Spine::TaggedLocationList get_tloclist(const Query& query,
   }
 }
 
+// Number of table rows PostProcessing::fill_table produces from the output of a
+// location. Only plain time series columns are counted, otherwise the count is unknown.
+std::optional<std::size_t> number_of_rows(const TS::OutputData& outputData)
+{
+  std::size_t rows = 0;
+  for (const auto& location_data : outputData)
+  {
+    const auto& columns = location_data.second;
+    for (const auto& column : columns)
+      if (!std::get_if<TS::TimeSeriesPtr>(&column))
+        return {};
+
+    // all columns start from the same row, the next location continues after the last one
+    if (!columns.empty())
+      rows += std::get<TS::TimeSeriesPtr>(columns.back())->size();
+  }
+  return rows;
+}
+
 }  // namespace
 
 QEngineQuery::QEngineQuery(const Plugin& thePlugin) : itsPlugin(thePlugin) {}
@@ -269,7 +450,7 @@ void QEngineQuery::resolveAreaLocations(Query& query,
   {
     Spine::LocationPtr loc = tloc.loc;
     Spine::LocationPtr area_loc;
-    NFmiSvgPath svgPath;
+    std::shared_ptr<const NFmiSvgPath> svgPath;
 
     if (tloc.loc->type == Spine::Location::BoundingBox)
       area_loc = get_bbox_location(
@@ -279,6 +460,7 @@ void QEngineQuery::resolveAreaLocations(Query& query,
                                        itsPlugin.itsGeometryStorage,
                                        query.language,
                                        *itsPlugin.itsEngines.geoEngine,
+                                       itsPlugin.itsGeometryCache.get(),
                                        &svgPath);
 
     auto producer = selectProducer(*area_loc, query, areaproducers);
@@ -288,22 +470,28 @@ void QEngineQuery::resolveAreaLocations(Query& query,
 
     auto qi = (query.origintime ? state.get(producer, *query.origintime) : state.get(producer));
 
+    auto* geometryCache = itsPlugin.itsGeometryCache.get();
+
     bool bbox_area = (qi->isGrid() && loc->type == Spine::Location::BoundingBox);
     bool area_area =
         (qi->isGrid() &&
-         (loc->type == Spine::Location::Area || is_wkt_area(loc) ||
+         (loc->type == Spine::Location::Area || is_wkt_area(loc, geometryCache) ||
           ((loc->type == Spine::Location::Place || loc->type == Spine::Location::CoordinatePoint) &&
            loc->radius > 0)));
 
     if (bbox_area || area_area)
     {
-      auto tlocs = get_tloclist(query,
+      auto tlocs = get_tloclist(state,
+                                query,
                                 tloc,
                                 loc,
                                 area_loc,
                                 qi,
                                 *itsPlugin.itsEngines.geoEngine,
                                 itsPlugin.itsGeometryStorage,
+                                geometryCache,
+                                itsPlugin.itsIndexMaskCache.get(),
+                                itsPlugin.itsLandscapeCache.get(),
                                 bbox_area,
                                 svgPath);
 
@@ -339,70 +527,438 @@ void QEngineQuery::processQEngineQuery(const State& state,
 
     bool firstProducer = outputData.empty();
 
+    // Data for each location is fetched only once
+    std::vector<const Spine::TaggedLocation*> tlocs;
     std::set<std::string> processed_locations;
     for (const auto& tloc : masterquery.loptions->locations())
+      if (processed_locations.insert(get_location_id(tloc.loc)).second)
+        tlocs.push_back(&tloc);
+
+    // In parallel mode each location is processed with a copy of the query,
+    // and always with its own output
+    std::vector<std::unique_ptr<Query>> queries(tlocs.size());
+    std::vector<TS::OutputData> outputs(tlocs.size());
+    std::vector<QueryLevelDataCache> levelDataCaches(tlocs.size());
+
+    // When only the first rows are needed for the requested page, the locations are
+    // fetched one by one until there are enough rows. The rows are in the order of
+    // the locations only if no location is repeated, and if this is the only output.
+    const bool paged = (masterquery.fetchrows > 0 && outputData.empty() &&
+                        tlocs.size() == masterquery.loptions->locations().size());
+
+    // Fetch plain point forecasts of the given locations at once where possible
+    auto prefetch = [&](std::size_t first, std::size_t last)
+    {
+      prefetchPointValues(state,
+                          masterquery,
+                          tlocs,
+                          first,
+                          last,
+                          first_timestep,
+                          firstProducer,
+                          areaproducers,
+                          producerDataPeriod,
+                          levelDataCaches);
+    };
+
+    auto process = [&](std::size_t i)
+    {
+      queries[i] = std::make_unique<Query>(masterquery);
+      fetchLocationValues(state,
+                          *queries[i],
+                          *tlocs[i],
+                          first_timestep,
+                          firstProducer,
+                          areaproducers,
+                          producerDataPeriod,
+                          levelDataCaches[i],
+                          outputs[i]);
+      levelDataCaches[i] = QueryLevelDataCache();
+    };
+
+    auto merge = [&](std::size_t i)
+    {
+      std::move(outputs[i].begin(), outputs[i].end(), std::back_inserter(outputData));
+      outputs[i].clear();
+    };
+
+    const auto max_threads = itsPlugin.itsConfig.maxRequestThreads();
+
+    if (!itsPlugin.itsTaskPool || max_threads <= 1 || tlocs.size() <= 1 || paged)
+    {
+      if (!paged)
+        prefetch(0, tlocs.size());
+
+      // Serial processing, each location continues from the latest timestep and the
+      // last point of the previous one. Only the location specific settings are reset.
+      const auto settings = masterquery.saveLocationSettings();
+      std::optional<std::size_t> rows = 0;
+      for (std::size_t i = 0; i < tlocs.size(); i++)
+      {
+        masterquery.restoreLocationSettings(settings);
+        fetchLocationValues(state,
+                            masterquery,
+                            *tlocs[i],
+                            first_timestep,
+                            firstProducer,
+                            areaproducers,
+                            producerDataPeriod,
+                            levelDataCaches[i],
+                            outputs[i]);
+        levelDataCaches[i] = QueryLevelDataCache();
+
+        if (paged && rows)
+        {
+          auto n = number_of_rows(outputs[i]);
+          rows = (n ? *rows + *n : n);
+        }
+
+        merge(i);
+
+        if (paged && rows && *rows >= masterquery.fetchrows)
+          break;
+      }
+      masterquery.restoreLocationSettings(settings);
+    }
+    else
+    {
+      // Parallel processing, each location starts from the state of the request.
+      // The results are merged in the original order, and the last location which
+      // updated the latest timestep or the last point determines the final values.
+      const auto original_timestep = masterquery.latestTimestep;
+      const auto original_lastpoint = masterquery.lastpoint;
+
+      // Each task prefetches and processes a contiguous chunk of the locations
+      const std::size_t nchunks = std::min<std::size_t>(tlocs.size(), max_threads);
+      auto process_chunk = [&](std::size_t chunk)
+      {
+        const std::size_t first = chunk * tlocs.size() / nchunks;
+        const std::size_t last = (chunk + 1) * tlocs.size() / nchunks;
+        prefetch(first, last);
+        for (std::size_t i = first; i < last; i++)
+          process(i);
+      };
+
+      run_parallel_tasks(itsPlugin.itsTaskPool.get(), nchunks, max_threads, process_chunk);
+
+      for (std::size_t i = 0; i < tlocs.size(); i++)
+      {
+        merge(i);
+
+        if (queries[i]->latestTimestep != original_timestep)
+          masterquery.latestTimestep = queries[i]->latestTimestep;
+        if (queries[i]->lastpoint != original_lastpoint)
+          masterquery.lastpoint = queries[i]->lastpoint;
+        queries[i].reset();
+      }
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Number of grid points inside an area
+ *
+ * The index mask is the same one used when the area is processed, and
+ * is hence usually found in the mask cache later on. Station data has
+ * no mask, and the number of points is unknown.
+ */
+// ----------------------------------------------------------------------
+
+std::optional<std::size_t> QEngineQuery::countAreaPoints(const State& state,
+                                                         const Spine::TaggedLocation& tloc,
+                                                         const Query& query,
+                                                         const Engine::Querydata::Q& qi) const
+{
+  try
+  {
+    if (!qi->isGrid())
+      return {};
+
+    auto* maskCache = itsPlugin.itsIndexMaskCache.get();
+
+    if (tloc.loc->type == Spine::Location::BoundingBox)
+      return get_bbox_indexmask(tloc.loc, qi, maskCache)->size();
+
+    const auto resolved = resolveLocation(state, tloc, query);
+    auto svgPath = resolved->svgPath;
+    if (!svgPath)
+      svgPath = get_svg_path(tloc, itsPlugin.itsGeometryStorage, itsPlugin.itsGeometryCache.get());
+
+    return get_indexmask(*svgPath, resolved->loc->radius, qi, maskCache)->size();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Fetch all parameters for a single location
+ *
+ * The query is modified. The caller passes either the master query with
+ * its location settings restored, or a copy of it when locations are
+ * processed in parallel.
+ */
+// ----------------------------------------------------------------------
+
+void QEngineQuery::fetchLocationValues(const State& state,
+                                       Query& q,
+                                       const Spine::TaggedLocation& tloc,
+                                       const Fmi::DateTime& first_timestep,
+                                       bool firstProducer,
+                                       const AreaProducers& areaproducers,
+                                       const ProducerDataPeriod& producerDataPeriod,
+                                       QueryLevelDataCache& queryLevelDataCache,
+                                       TS::OutputData& outputData) const
+{
+  try
+  {
+    std::vector<TS::TimeSeriesData> tsdatavector;
+    outputData.emplace_back(make_pair(get_location_id(tloc.loc), tsdatavector));
+
+    if (q.timezone == LOCALTIME_PARAM)
+      q.timezone = tloc.loc->timezone;
+
+    q.toptions.startTime = first_timestep;
+    if (!firstProducer)
+      q.toptions.startTime += Fmi::Minutes(1);
+
+    // producer can be alias, get actual producer
+    std::string producer(selectProducer(*(tloc.loc), q, areaproducers));
+    bool isClimatologyProducer =
+        (producer.empty()
+             ? false
+             : itsPlugin.itsEngines.qEngine->getProducerConfig(producer).isclimatology);
+
+    Fmi::LocalDateTime data_period_endtime(
+        producerDataPeriod.getLocalEndTime(producer, q.timezone, state));
+
+    // every parameter starts from the same row
+    if (!data_period_endtime.is_not_a_date_time() &&
+        q.toptions.endTime > data_period_endtime.local_time() && !isClimatologyProducer)
+    {
+      q.toptions.endTime = data_period_endtime.local_time();
+    }
+
+    // The producer, data, levels and times are the same for all parameters
+    LocationContext context;
+    if (!prepareLocationContext(state, tloc, q, areaproducers, producerDataPeriod, context))
+      return;
+
+    // A point produces a value for each parameter, level and time step. Reject
+    // requests which would exceed the limit before fetching the values.
+    if (context.isPointQuery)
+      check_request_limit(itsPlugin.itsConfig.requestLimits(),
+                          state.getElementCount() + q.poptions.parameterFunctions().size() *
+                                                        context.levelCount * context.tlist.size(),
+                          TS::RequestLimitMember::ELEMENTS);
+
+    int column = 0;
+    for (const TS::ParameterAndFunctions& paramfunc : q.poptions.parameterFunctions())
+    {
+      fetchQEngineValues(state,
+                         paramfunc,
+                         q.precisions[column],
+                         tloc,
+                         q,
+                         context,
+                         queryLevelDataCache,
+                         outputData);
+      column++;
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Fetch plain point forecasts of several locations with one call
+ *
+ * Point locations first...last-1 which use the same grid producer and
+ * time zone are fetched with the multi-location values call, and the results
+ * are stored into the level data caches of the locations. pointQuery then
+ * finds them there. Everything else is left for the normal per location
+ * processing. The request limit is checked before anything is fetched.
+ */
+// ----------------------------------------------------------------------
+
+void QEngineQuery::prefetchPointValues(const State& state,
+                                       const Query& masterquery,
+                                       const std::vector<const Spine::TaggedLocation*>& tlocs,
+                                       std::size_t first,
+                                       std::size_t last,
+                                       const Fmi::DateTime& first_timestep,
+                                       bool firstProducer,
+                                       const AreaProducers& areaproducers,
+                                       const ProducerDataPeriod& producerDataPeriod,
+                                       std::vector<QueryLevelDataCache>& levelDataCaches) const
+{
+  try
+  {
+    // The nearest valid point search and pressure/height interpolation are done per location
+    if (last < first + 2 || masterquery.findnearestvalidpoint || !masterquery.pressures.empty() ||
+        !masterquery.heights.empty())
+      return;
+
+    // Group the point locations by producer and time zone
+    std::map<std::pair<std::string, std::string>, std::vector<std::size_t>> groups;
+    for (std::size_t i = first; i < last; i++)
     {
-      std::string location_id = get_location_id(tloc.loc);
-      // Data for each location is fetched only once
-      if (processed_locations.find(location_id) != processed_locations.end())
+      const auto& loc = tlocs[i]->loc;
+      if ((loc->type != Spine::Location::Place && loc->type != Spine::Location::CoordinatePoint) ||
+          loc->radius != 0)
         continue;
-      processed_locations.insert(location_id);
 
-      Query q = masterquery;
-      QueryLevelDataCache queryLevelDataCache;
+      auto producer = selectProducer(*loc, masterquery, areaproducers);
+      if (producer.empty())
+        continue;
+
+      const auto& timezone =
+          (masterquery.timezone == LOCALTIME_PARAM ? loc->timezone : masterquery.timezone);
+      groups[std::make_pair(producer, timezone)].push_back(i);
+    }
 
-      std::vector<TS::TimeSeriesData> tsdatavector;
-      outputData.emplace_back(make_pair(location_id, tsdatavector));
+    for (const auto& group : groups)
+    {
+      const auto& indexes = group.second;
+      if (indexes.size() < 2)
+        continue;
 
-      if (masterquery.timezone == LOCALTIME_PARAM)
-        q.timezone = tloc.loc->timezone;
+      const auto& producer = group.first.first;
 
+      // Set up the query the same way as fetchLocationValues and fetchQEngineValues do
+      Query q = masterquery;
+      q.timezone = group.first.second;
       q.toptions.startTime = first_timestep;
       if (!firstProducer)
         q.toptions.startTime += Fmi::Minutes(1);
 
-      // producer can be alias, get actual producer
-      std::string producer(selectProducer(*(tloc.loc), q, areaproducers));
-      bool isClimatologyProducer =
-          (producer.empty()
-               ? false
-               : itsPlugin.itsEngines.qEngine->getProducerConfig(producer).isclimatology);
+      auto qi = (q.origintime ? state.get(producer, *q.origintime) : state.get(producer));
+
+      // Point values of station data come from the nearest station, which only
+      // the per location processing reports correctly as the last point
+      if (!qi->isGrid())
+        continue;
 
-      Fmi::LocalDateTime data_period_endtime(producerDataPeriod.getLocalEndTime(
-          producer, q.timezone, itsPlugin.itsEngines.geoEngine->getTimeZones()));
+      bool isClimatologyProducer =
+          itsPlugin.itsEngines.qEngine->getProducerConfig(producer).isclimatology;
+      Fmi::LocalDateTime data_period_endtime(
+          producerDataPeriod.getLocalEndTime(producer, q.timezone, state));
+      if (!data_period_endtime.is_not_a_date_time() &&
+          q.toptions.endTime > data_period_endtime.local_time() && !isClimatologyProducer)
+        q.toptions.endTime = data_period_endtime.local_time();
+
+      const auto validtimes = qi->validTimes();
+      if (!validtimes || validtimes->empty())
+        continue;
+      q.toptions.setDataTimes(validtimes, qi->isClimatology());
 
-      // Reset for each new location, since fetchQEngineValues modifies it
-      auto old_start_time = q.toptions.startTime;
+      const auto tlist = generateTList(state, q, producer, producerDataPeriod);
+      if (tlist.empty())
+        continue;
 
-      int column = 0;
-      for (const TS::ParameterAndFunctions& paramfunc : q.poptions.parameterFunctions())
+      std::size_t levelCount = 0;
+      for (qi->resetLevel(); qi->nextLevel();)
+        if (q.levels.empty() || q.levels.find(static_cast<int>(qi->levelValue())) != q.levels.end())
+          ++levelCount;
+
+      // Reject requests which would exceed the limit before fetching the values,
+      // like fetchLocationValues does for a single point
+      check_request_limit(itsPlugin.itsConfig.requestLimits(),
+                          state.getElementCount() + indexes.size() *
+                                                        q.poptions.parameterFunctions().size() *
+                                                        levelCount * tlist.size(),
+                          TS::RequestLimitMember::ELEMENTS);
+
+      Spine::LocationList llist;
+      for (auto i : indexes)
+        llist.push_back(tlocs[i]->loc);
+
+      const auto& first_tloc = *tlocs[indexes.front()];
+      const auto resolved = resolveLocation(state, first_tloc, q);
+      const auto& country = resolved->country;
+
+      bool prefetched = false;
+      for (const auto& paramfunc : q.poptions.parameterFunctions())
       {
-        // reset to original start time for each new location
-        q.toptions.startTime = old_start_time;
+        const auto& paramname = paramfunc.parameter.name();
+        if (UtilityFunctions::is_special_parameter(paramname) || paramname == "fmisid" ||
+            paramname == "wsi" || paramname == "x" || paramname == "y")
+          continue;
 
-        // every parameter starts from the same row
-        if (!data_period_endtime.is_not_a_date_time() &&
-            q.toptions.endTime > data_period_endtime.local_time() && !isClimatologyProducer)
+        Spine::Parameter param = TS::get_query_param(paramfunc.parameter);
+        if (param.type() != Spine::Parameter::Type::Data)
+          continue;
+
+        auto querydata_tlist = generateQEngineQueryTimes(state, q, paramname);
+
+        for (qi->resetLevel(); qi->nextLevel();)
         {
-          q.toptions.endTime = data_period_endtime.local_time();
+          float levelValue = qi->levelValue();
+
+          int level = static_cast<int>(levelValue);
+          if (!q.levels.empty() && q.levels.find(level) == q.levels.end())
+            continue;
+
+          std::pair<float, std::string> cacheKey(levelValue, "data:" + paramname);
+
+          const auto& first_cache = levelDataCaches[indexes.front()].itsTimeSeries;
+          if (first_cache.find(cacheKey) != first_cache.end())
+            continue;
+
+          Engine::Querydata::ParameterOptions querydata_param(param,
+                                                              producer,
+                                                              *first_tloc.loc,
+                                                              country,
+                                                              first_tloc.tag,
+                                                              *q.timeformatter,
+                                                              q.timestring,
+                                                              q.language,
+                                                              q.outlocale,
+                                                              q.timezone,
+                                                              q.findnearestvalidpoint,
+                                                              q.maxdistance_kilometers(),
+                                                              q.lastpoint);
+
+          TS::TimeSeriesGroupPtr result;
+          {
+            TraceSpan span(state, "qengine", producer, llist.size());
+            result =
+                qi->values(querydata_param, llist, querydata_tlist, q.maxdistance_kilometers());
+          }
+
+          // The results are in the order of the locations. Locations outside the data
+          // are missing from the result, in which case the positions are unknown and
+          // everything is left for the normal processing.
+          if (result->size() != indexes.size())
+            continue;
+
+          for (std::size_t pos = 0; pos < indexes.size(); pos++)
+          {
+            const auto& llts = (*result)[pos];
+            if (!llts.timeseries.empty())
+              levelDataCaches[indexes[pos]].itsTimeSeries.insert(
+                  std::make_pair(cacheKey, std::make_shared<TS::TimeSeries>(llts.timeseries)));
+          }
+          prefetched = true;
         }
-        fetchQEngineValues(state,
-                           paramfunc,
-                           q.precisions[column],
-                           tloc,
-                           q,
-                           areaproducers,
-                           producerDataPeriod,
-                           queryLevelDataCache,
-                           outputData);
-        column++;
-        check_request_limit(itsPlugin.itsConfig.requestLimits(),
-                            TS::number_of_elements(outputData),
-                            TS::RequestLimitMember::ELEMENTS);
       }
-      // get the latest_timestep from previous query
-      masterquery.latestTimestep = q.latestTimestep;
-      masterquery.lastpoint = q.lastpoint;
+
+      // Without the nearest valid point search grid data is interpolated at the
+      // coordinates of the location, and the last point is set accordingly
+      if (prefetched)
+        for (auto i : indexes)
+          levelDataCaches[i].itsLastPoint =
+              NFmiPoint(tlocs[i]->loc->longitude, tlocs[i]->loc->latitude);
     }
   }
   catch (...)
@@ -416,7 +972,8 @@ void QEngineQuery::fetchQEngineValues(const State& state,
                                       const std::string& producer,
                                       const TS::ParameterAndFunctions& paramfunc,
                                       const Spine::TaggedLocation& tloc,
-                                      const ProducerDataPeriod& producerDataPeriod,
+                                      const TS::TimeSeriesGenerator::LocalTimeList& tlist,
+                                      const TS::TimeSeriesGenerator::LocalTimeList& querydata_tlist,
                                       const Engine::Querydata::Q& qi,
                                       double maxdist,
                                       int precision,
@@ -432,17 +989,10 @@ void QEngineQuery::fetchQEngineValues(const State& state,
   try
   {
     auto paramname = paramfunc.parameter.name();
-    auto tz = itsPlugin.itsEngines.geoEngine->getTimeZones().time_zone_from_string(query.timezone);
-    auto tlist = generateTList(query, producer, producerDataPeriod);
 
     if (tlist.empty())
       return;
 
-    check_request_limit(
-        itsPlugin.itsConfig.requestLimits(), tlist.size(), TS::RequestLimitMember::TIMESTEPS);
-
-    auto querydata_tlist = generateQEngineQueryTimes(query, paramname);
-
     std::pair<float, std::string> cacheKey(loadDataLevels ? qi->levelValue() : levelValue,
                                            levelType + paramname);
 
@@ -511,64 +1061,64 @@ void QEngineQuery::fetchQEngineValues(const State& state,
   }
 }
 
-void QEngineQuery::fetchQEngineValues(const State& state,
-                                      const TS::ParameterAndFunctions& paramfunc,
-                                      int precision,
-                                      const Spine::TaggedLocation& tloc,
-                                      Query& query,
-                                      const AreaProducers& areaproducers,
-                                      const ProducerDataPeriod& producerDataPeriod,
-                                      QueryLevelDataCache& queryLevelDataCache,
-                                      TS::OutputData& outputData) const
+// ----------------------------------------------------------------------
+/*!
+ * \brief Resolve the settings shared by all parameters of a location
+ *
+ * Returns false if the location cannot be handled with the selected data.
+ */
+// ----------------------------------------------------------------------
+
+bool QEngineQuery::prepareLocationContext(const State& state,
+                                          const Spine::TaggedLocation& tloc,
+                                          Query& query,
+                                          const AreaProducers& areaproducers,
+                                          const ProducerDataPeriod& producerDataPeriod,
+                                          LocationContext& context) const
 {
   try
   {
-    Spine::LocationPtr loc = tloc.loc;
-    std::string place = get_name_base(loc->name);
+    std::string place = get_name_base(tloc.loc->name);
 
-    NFmiSvgPath svgPath;
-    bool isWkt = false;
-    loc = resolveLocation(tloc, query, svgPath, isWkt);
+    const auto resolved = resolveLocation(state, tloc, query);
+    const auto& loc = resolved->loc;
 
     if (query.timezone == LOCALTIME_PARAM)
       query.timezone = loc->timezone;
 
     // Select the producer for the coordinate
-    auto producer = selectProducer(*loc, query, areaproducers);
+    context.producer = selectProducer(*loc, query, areaproducers);
 
-    require_producer(producer, place);
+    require_producer(context.producer, place);
 
-    auto qi = (query.origintime ? state.get(producer, *query.origintime) : state.get(producer));
+    context.qi = (query.origintime ? state.get(context.producer, *query.origintime)
+                                   : state.get(context.producer));
 
-    const auto validtimes = qi->validTimes();
-    require_validtimes(validtimes, producer);
+    const auto validtimes = context.qi->validTimes();
+    require_validtimes(validtimes, context.producer);
 
-    query.toptions.setDataTimes(validtimes, qi->isClimatology());
+    query.toptions.setDataTimes(validtimes, context.qi->isClimatology());
 
     // No area operations allowed for non-grid data
-    bool isPointQuery = is_point_query(loc);
-    if (!qi->isGrid() && !isPointQuery)
-      return;
-
-    std::string country = state.getGeoEngine().countryName(loc->iso2, query.language);
-
-    std::vector<TS::TimeSeriesData> aggregatedData;  // store here data of all levels
+    context.isPointQuery = is_point_query(loc, itsPlugin.itsGeometryCache.get());
+    if (!context.qi->isGrid() && !context.isPointQuery)
+      return false;
 
     // If no pressures/heights are chosen, loading all or just chosen data levels.
     //
     // Otherwise loading chosen data levels if any, then the chosen pressure
     // and/or height levels (interpolated values at chosen pressures/heights)
 
-    bool loadDataLevels =
+    context.loadDataLevels =
         (!query.levels.empty() || (query.pressures.empty() && query.heights.empty()));
 
     // Check the total number of levels
     std::set<float> received_levels;
-    if (loadDataLevels)
+    if (context.loadDataLevels)
     {
-      for (qi->resetLevel(); qi->nextLevel();)
+      for (context.qi->resetLevel(); context.qi->nextLevel();)
       {
-        float levelValue = qi->levelValue();
+        float levelValue = context.qi->levelValue();
 
         // check if only some levels are chosen
         int level = static_cast<int>(levelValue);
@@ -579,11 +1129,45 @@ void QEngineQuery::fetchQEngineValues(const State& state,
       }
     }
 
-    check_request_limit(itsPlugin.itsConfig.requestLimits(),
-                        received_levels.size() + query.heights.size() + query.pressures.size(),
-                        TS::RequestLimitMember::LEVELS);
+    context.levelCount = received_levels.size() + query.heights.size() + query.pressures.size();
+    check_request_limit(
+        itsPlugin.itsConfig.requestLimits(), context.levelCount, TS::RequestLimitMember::LEVELS);
+
+    context.tlist = generateTList(state, query, context.producer, producerDataPeriod);
+
+    if (!context.tlist.empty())
+      check_request_limit(itsPlugin.itsConfig.requestLimits(),
+                          context.tlist.size(),
+                          TS::RequestLimitMember::TIMESTEPS);
+
+    return true;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+void QEngineQuery::fetchQEngineValues(const State& state,
+                                      const TS::ParameterAndFunctions& paramfunc,
+                                      int precision,
+                                      const Spine::TaggedLocation& tloc,
+                                      Query& query,
+                                      const LocationContext& context,
+                                      QueryLevelDataCache& queryLevelDataCache,
+                                      TS::OutputData& outputData) const
+{
+  try
+  {
+    const auto& producer = context.producer;
+    const auto& qi = context.qi;
+
+    // Only aggregation intervals depend on the parameter
+    auto querydata_tlist = generateQEngineQueryTimes(state, query, paramfunc.parameter.name());
+
+    std::vector<TS::TimeSeriesData> aggregatedData;  // store here data of all levels
 
-    if (loadDataLevels)
+    if (context.loadDataLevels)
     {
       for (qi->resetLevel(); qi->nextLevel();)
       {
@@ -598,12 +1182,13 @@ void QEngineQuery::fetchQEngineValues(const State& state,
                            producer,
                            paramfunc,
                            tloc,
-                           producerDataPeriod,
+                           context.tlist,
+                           querydata_tlist,
                            qi,
                            query.maxdistance_kilometers(),
                            precision,
-                           isPointQuery,
-                           loadDataLevels,
+                           context.isPointQuery,
+                           context.loadDataLevels,
                            levelValue,
                            "data:",
                            {},
@@ -620,11 +1205,12 @@ void QEngineQuery::fetchQEngineValues(const State& state,
                          producer,
                          paramfunc,
                          tloc,
-                         producerDataPeriod,
+                         context.tlist,
+                         querydata_tlist,
                          qi,
                          query.maxdistance_kilometers(),
                          precision,
-                         isPointQuery,
+                         context.isPointQuery,
                          false,  // loadDataLevels
                          pressure,
                          "pressure:",
@@ -641,11 +1227,12 @@ void QEngineQuery::fetchQEngineValues(const State& state,
                          producer,
                          paramfunc,
                          tloc,
-                         producerDataPeriod,
+                         context.tlist,
+                         querydata_tlist,
                          qi,
                          query.maxdistance_kilometers(),
                          precision,
-                         isPointQuery,
+                         context.isPointQuery,
                          false,  // loadDataLevels
                          height,
                          "height:",
@@ -655,8 +1242,11 @@ void QEngineQuery::fetchQEngineValues(const State& state,
                          aggregatedData);
     }
 
-    // store level-data
-    PostProcessing::store_data(aggregatedData, query, outputData);
+    // store level-data, and check the limit against the running total of the request
+    auto elements = PostProcessing::store_data(aggregatedData, query, outputData);
+    check_request_limit(itsPlugin.itsConfig.requestLimits(),
+                        state.addElements(elements),
+                        TS::RequestLimitMember::ELEMENTS);
   }
   catch (...)
   {
@@ -665,11 +1255,11 @@ void QEngineQuery::fetchQEngineValues(const State& state,
 }
 
 TS::TimeSeriesGenerator::LocalTimeList QEngineQuery::generateQEngineQueryTimes(
-    const Query& query, const std::string& paramname) const
+    const State& state, const Query& query, const std::string& paramname) const
 {
   try
   {
-    auto tz = itsPlugin.itsEngines.geoEngine->getTimeZones().time_zone_from_string(query.timezone);
+    auto tz = state.getTimeZone(query.timezone);
     auto tlist = itsPlugin.itsTimeSeriesCache->generate(query.toptions, tz);
 
     // time list may be empty for example due to bad query string options
@@ -764,17 +1354,17 @@ void QEngineQuery::pointQuery(const Query& theQuery,
     TS::TimeSeriesPtr querydata_result;
     const auto& paramname = theParamFunc.parameter.name();
 
-    auto loc = theTLoc.loc;
-    NFmiSvgPath svgPath;
-    bool isWkt = false;
-    loc = resolveLocation(theTLoc, theQuery, svgPath, isWkt);
-    const auto country = itsPlugin.itsEngines.geoEngine->countryName(loc->iso2, theQuery.language);
+    const auto resolved = resolveLocation(theState, theTLoc, theQuery);
+    const auto& loc = resolved->loc;
+    const auto& country = resolved->country;
 
     // if we have fetched the data for this parameter earlier, use it
     if (theQueryLevelDataCache.itsTimeSeries.find(theCacheKey) !=
         theQueryLevelDataCache.itsTimeSeries.end())
     {
       querydata_result = theQueryLevelDataCache.itsTimeSeries[theCacheKey];
+      if (theQueryLevelDataCache.itsLastPoint)
+        theQuery.lastpoint = *theQueryLevelDataCache.itsLastPoint;
     }
     else if ((paramname == "fmisid" && loc->fmisid) || paramname == "wsi")
     {
@@ -807,25 +1397,76 @@ void QEngineQuery::pointQuery(const Query& theQuery,
     {
       Spine::Parameter param = TS::get_query_param(theParamFunc.parameter);
 
-      Engine::Querydata::ParameterOptions querydata_param(param,
-                                                          theProducer,
-                                                          *loc,
-                                                          country,
-                                                          theTLoc.tag,
-                                                          *theQuery.timeformatter,
-                                                          theQuery.timestring,
-                                                          theQuery.language,
-                                                          theQuery.outlocale,
-                                                          theQuery.timezone,
-                                                          theQuery.findnearestvalidpoint,
-                                                          theMaxDist,
-                                                          theQuery.lastpoint);
+      // Plain data parameters depend only on the data, the point and the times and
+      // can hence be shared between requests. The x and y coordinates are transformed
+      // in place below and are not shared.
+      const auto& pointValueCache = itsPlugin.itsPointValueCache;
+      std::optional<PointValueKey> point_key;
+      std::size_t point_hash = Fmi::bad_hash;
+      if (pointValueCache && param.type() == Spine::Parameter::Type::Data && paramname != "x" &&
+          paramname != "y")
+      {
+        point_key = point_values_key(theQ,
+                                     theProducer,
+                                     param,
+                                     *loc,
+                                     theQuery,
+                                     theQueryDataTlist,
+                                     theCacheKey,
+                                     theMaxDist,
+                                     theLoadDataLevels,
+                                     thePressure,
+                                     theHeight);
+        point_hash = hash_value(*point_key);
+      }
 
-      // one location, list of local times (no radius -> pointforecast)
-      querydata_result =
-          theLoadDataLevels ? theQ->values(querydata_param, theQueryDataTlist)
-          : thePressure ? theQ->valuesAtPressure(querydata_param, theQueryDataTlist, *thePressure)
-                        : theQ->valuesAtHeight(querydata_param, theQueryDataTlist, *theHeight);
+      std::shared_ptr<const PointValues> cached_values;
+      if (point_key)
+      {
+        auto cached = pointValueCache->find(point_hash);
+        if (cached && (*cached)->key == *point_key)
+          cached_values = *cached;
+      }
+
+      if (cached_values)
+      {
+        // The cached values are shared by all requests, hence the post processing
+        // below must work on a copy of its own
+        querydata_result = std::make_shared<TS::TimeSeries>(*cached_values->values);
+        theQuery.lastpoint = cached_values->lastpoint;
+      }
+      else
+      {
+        Engine::Querydata::ParameterOptions querydata_param(param,
+                                                            theProducer,
+                                                            *loc,
+                                                            country,
+                                                            theTLoc.tag,
+                                                            *theQuery.timeformatter,
+                                                            theQuery.timestring,
+                                                            theQuery.language,
+                                                            theQuery.outlocale,
+                                                            theQuery.timezone,
+                                                            theQuery.findnearestvalidpoint,
+                                                            theMaxDist,
+                                                            theQuery.lastpoint);
+
+        // one location, list of local times (no radius -> pointforecast)
+        TraceSpan span(theState, "qengine", theProducer);
+        querydata_result =
+            theLoadDataLevels ? theQ->values(querydata_param, theQueryDataTlist)
+            : thePressure ? theQ->valuesAtPressure(querydata_param, theQueryDataTlist, *thePressure)
+                          : theQ->valuesAtHeight(querydata_param, theQueryDataTlist, *theHeight);
+
+        if (point_key)
+        {
+          auto values = std::make_shared<PointValues>();
+          values->key = std::move(*point_key);
+          values->values = std::make_shared<const TS::TimeSeries>(*querydata_result);
+          values->lastpoint = theQuery.lastpoint;
+          pointValueCache->insert(point_hash, values);
+        }
+      }
     }
     if (!querydata_result->empty())
     {
@@ -836,6 +1477,7 @@ void QEngineQuery::pointQuery(const Query& theQuery,
       theQueryLevelDataCache.itsTimeSeries.insert(make_pair(theCacheKey, querydata_result));
     }
 
+    TraceSpan span(theState, "aggregation");
     auto aggregated_querydata_result =
         TS::aggregate(querydata_result, theParamFunc.functions, theRequestedTList);
     aggregated_querydata_result =
@@ -851,7 +1493,7 @@ void QEngineQuery::pointQuery(const Query& theQuery,
 Spine::LocationList QEngineQuery::getLocationListForPath(const Query& theQuery,
                                                          const Spine::TaggedLocation& theTLoc,
                                                          const std::string& place,
-                                                         const NFmiSvgPath svgPath,
+                                                         const NFmiSvgPath& svgPath,
                                                          const State& theState,
                                                          bool isWkt) const
 {
@@ -934,8 +1576,8 @@ TS::TimeSeriesGroupPtr QEngineQuery::getQEngineValuesForArea(
     else
     {
       Spine::Parameter param = TS::get_query_param(theParamFunc.parameter);
-      const auto country =
-          itsPlugin.itsEngines.geoEngine->countryName(loc->iso2, theQuery.language);
+      const auto resolved = resolveLocation(theState, theTLoc, theQuery);
+      const auto& country = resolved->country;
 
       Engine::Querydata::ParameterOptions querydata_param(param,
                                                           theProducer,
@@ -956,6 +1598,7 @@ TS::TimeSeriesGroupPtr QEngineQuery::getQEngineValuesForArea(
       querydata_param.distanceReferencePoint = theDistanceReferencePoint;
 
       // list of locations, list of local times
+      TraceSpan span(theState, "qengine", theProducer, llist.size());
       querydata_result =
           theLoadDataLevels
               ? theQ->values(
@@ -980,53 +1623,39 @@ TS::TimeSeriesGroupPtr QEngineQuery::getQEngineValuesForArea(
   }
 }
 
-Spine::LocationList QEngineQuery::getLocationListForArea(const Spine::TaggedLocation& theTLoc,
-                                                         const Spine::LocationPtr& loc,
-                                                         const Engine::Querydata::Q& theQ,
-                                                         NFmiSvgPath& svgPath,
-                                                         bool isWkt) const
+Spine::LocationList QEngineQuery::getLocationListForArea(
+    const State& theState,
+    const Spine::TaggedLocation& theTLoc,
+    const Spine::LocationPtr& loc,
+    const Engine::Querydata::Q& theQ,
+    std::shared_ptr<const NFmiSvgPath>& svgPath,
+    bool isWkt) const
 {
   try
   {
-    NFmiIndexMask mask;
+    auto* maskCache = itsPlugin.itsIndexMaskCache.get();
+    std::shared_ptr<const NFmiIndexMask> mask = std::make_shared<NFmiIndexMask>();
 
     if (loc->type == Spine::Location::BoundingBox)
     {
-      const auto place = get_name_base(loc->name);
-      std::vector<std::string> coordinates;
-      boost::algorithm::split(coordinates, place, boost::algorithm::is_any_of(","));
-      if (coordinates.size() != 4)
-        throw Fmi::Exception(BCP,
-                             "Invalid bbox parameter " + place +
-                                 ", should be in format 'lon,lat,lon,lat[:radius]'!");
-
-      std::string lonstr1 = coordinates[0];
-      std::string latstr1 = coordinates[1];
-      std::string lonstr2 = coordinates[2];
-      std::string latstr2 = coordinates[3];
-
-      if (latstr2.find(':') != std::string::npos)
-        latstr2.erase(latstr2.begin() + latstr2.find(':'), latstr2.end());
-
-      double lon1 = Fmi::stod(lonstr1);
-      double lat1 = Fmi::stod(latstr1);
-      double lon2 = Fmi::stod(lonstr2);
-      double lat2 = Fmi::stod(latstr2);
-
-      NFmiSvgPath boundingBoxPath;
-      NFmiSvgTools::BBoxToSvgPath(boundingBoxPath, lon1, lat1, lon2, lat2);
-      mask = NFmiIndexMaskTools::MaskExpand(theQ->grid(), boundingBoxPath, loc->radius);
+      mask = get_bbox_indexmask(loc, theQ, maskCache);
     }
     else if (loc->type == Spine::Location::Area || loc->type == Spine::Location::Place ||
              loc->type == Spine::Location::CoordinatePoint)
     {
       if (!isWkt)  // SVG for WKT has been extracted earlier
-        get_svg_path(theTLoc, itsPlugin.itsGeometryStorage, svgPath);
+        svgPath =
+            get_svg_path(theTLoc, itsPlugin.itsGeometryStorage, itsPlugin.itsGeometryCache.get());
       // If SVG has been extarcted earier the radius is already included
-      mask = NFmiIndexMaskTools::MaskExpand(theQ->grid(), svgPath, isWkt ? 0 : loc->radius);
+      mask = get_indexmask(*svgPath, isWkt ? 0 : loc->radius, theQ, maskCache);
     }
     // Indexmask (indexed locations on the area)
-    return get_indexmask_locations(mask, loc, theQ, *itsPlugin.itsEngines.geoEngine);
+    return get_indexmask_locations(theState,
+                                   *mask,
+                                   loc,
+                                   theQ,
+                                   *itsPlugin.itsEngines.geoEngine,
+                                   itsPlugin.itsLandscapeCache.get());
   }
   catch (...)
   {
@@ -1053,15 +1682,12 @@ void QEngineQuery::areaQuery(const Query& theQuery,
 {
   try
   {
-    auto loc = theTLoc.loc;
-
-    auto place = get_name_base(loc->name);
+    auto place = get_name_base(theTLoc.loc->name);
     const auto& paramname = theParamFunc.parameter.name();
 
-    bool isWkt = false;
-    NFmiSvgPath svgPath;
-    loc = resolveLocation(theTLoc, theQuery, svgPath, isWkt);
-    const auto country = itsPlugin.itsEngines.geoEngine->countryName(loc->iso2, theQuery.language);
+    const auto resolved = resolveLocation(theState, theTLoc, theQuery);
+    const auto& loc = resolved->loc;
+    const bool isWkt = resolved->isWkt;
 
     TS::TimeSeriesGroupPtr querydata_result;
 
@@ -1072,10 +1698,13 @@ void QEngineQuery::areaQuery(const Query& theQuery,
     }
     else
     {
+      // Shared, the path of the resolved location is not modified
+      auto svgPath = resolved->svgPath;
+
       if (loc->type == Spine::Location::Path)
       {
         Spine::LocationList llist =
-            getLocationListForPath(theQuery, theTLoc, place, svgPath, theState, isWkt);
+            getLocationListForPath(theQuery, theTLoc, place, *svgPath, theState, isWkt);
 
         check_request_limit(
             itsPlugin.itsConfig.requestLimits(), llist.size(), TS::RequestLimitMember::LOCATIONS);
@@ -1101,7 +1730,8 @@ void QEngineQuery::areaQuery(const Query& theQuery,
                 loc->type == Spine::Location::Place ||
                 loc->type == Spine::Location::CoordinatePoint))
       {
-        Spine::LocationList llist = getLocationListForArea(theTLoc, loc, theQ, svgPath, isWkt);
+        Spine::LocationList llist =
+            getLocationListForArea(theState, theTLoc, loc, theQ, svgPath, isWkt);
         check_request_limit(
             itsPlugin.itsConfig.requestLimits(), llist.size(), TS::RequestLimitMember::LOCATIONS);
 
@@ -1140,6 +1770,7 @@ void QEngineQuery::areaQuery(const Query& theQuery,
       }  // area handling
     }
 
+    TraceSpan span(theState, "aggregation");
     auto aggregated_query_data_result =
         TS::aggregate(querydata_result, theParamFunc.functions, theRequestedTList);
 
@@ -1156,7 +1787,8 @@ void QEngineQuery::areaQuery(const Query& theQuery,
   }
 }
 
-Spine::LocationList QEngineQuery::getNearestStationLocations(const Engine::Querydata::Q& theQ,
+Spine::LocationList QEngineQuery::getNearestStationLocations(const State& theState,
+                                                             const Engine::Querydata::Q& theQ,
                                                              const Spine::LocationPtr& loc,
                                                              int numberofstations,
                                                              double theMaxDist) const
@@ -1190,7 +1822,7 @@ Spine::LocationList QEngineQuery::getNearestStationLocations(const Engine::Query
       station.type = Spine::Location::CoordinatePoint;
       station.radius = 0;
 
-      llist.emplace_back(std::make_shared<Spine::Location>(station));
+      llist.emplace_back(theState.makeLocation(station));
     }
 
     return llist;
@@ -1222,9 +1854,8 @@ void QEngineQuery::stationsQuery(const Query& theQuery,
   {
     const auto& paramname = theParamFunc.parameter.name();
 
-    NFmiSvgPath svgPath;
-    bool isWkt = false;
-    Spine::LocationPtr loc = resolveLocation(theTLoc, theQuery, svgPath, isWkt);
+    const auto resolved = resolveLocation(theState, theTLoc, theQuery);
+    const auto& loc = resolved->loc;
 
     TS::TimeSeriesGroupPtr querydata_result;
 
@@ -1236,7 +1867,7 @@ void QEngineQuery::stationsQuery(const Query& theQuery,
     else
     {
       Spine::LocationList llist =
-          getNearestStationLocations(theQ, loc, theQuery.numberofstations, theMaxDist);
+          getNearestStationLocations(theState, theQ, loc, theQuery.numberofstations, theMaxDist);
 
       if (llist.empty())
         return;
@@ -1274,6 +1905,7 @@ void QEngineQuery::stationsQuery(const Query& theQuery,
       }
     }
 
+    TraceSpan span(theState, "aggregation");
     auto aggregated_query_data_result =
         TS::aggregate(querydata_result, theParamFunc.functions, theRequestedTList);
 
@@ -1324,21 +1956,38 @@ Engine::Querydata::Producer QEngineQuery::selectProducer(const Spine::Location&
   }
 }
 
-Spine::LocationPtr QEngineQuery::resolveLocation(const Spine::TaggedLocation& tloc,
-                                                 const Query& query,
-                                                 NFmiSvgPath& svgPath,
-                                                 bool& isWkt) const
+// ----------------------------------------------------------------------
+/*!
+ * \brief Resolve the location, country name and time zone only once per request
+ */
+// ----------------------------------------------------------------------
+
+ResolvedLocationPtr QEngineQuery::resolveLocation(const State& state,
+                                                  const Spine::TaggedLocation& tloc,
+                                                  const Query& query) const
 {
   try
   {
+    const std::string key = tloc.tag + '\t' + get_location_id(tloc.loc) + '\t' +
+                            Fmi::to_string(static_cast<int>(tloc.loc->type)) + '\t' +
+                            Fmi::to_string(tloc.loc->radius);
+
+    auto ret = state.getResolvedLocation(key);
+    if (ret)
+      return ret;
+
+    TraceSpan span(state, "locations");
+    auto resolved = std::make_shared<ResolvedLocation>();
+
     Spine::LocationPtr loc = tloc.loc;
     std::string place = get_name_base(loc->name);
 
     if (loc->type == Spine::Location::Wkt)
     {
       loc = query.wktGeometries.getLocation(tloc.loc->name);
-      svgPath = query.wktGeometries.getSvgPath(tloc.loc->name);
-      isWkt = true;
+      resolved->svgPath =
+          std::make_shared<const NFmiSvgPath>(query.wktGeometries.getSvgPath(tloc.loc->name));
+      resolved->isWkt = true;
     }
     else if (loc->type == Spine::Location::Path || loc->type == Spine::Location::Area)
     {
@@ -1346,7 +1995,8 @@ Spine::LocationPtr QEngineQuery::resolveLocation(const Spine::TaggedLocation& tl
                                   itsPlugin.itsGeometryStorage,
                                   query.language,
                                   *itsPlugin.itsEngines.geoEngine,
-                                  &svgPath);
+                                  itsPlugin.itsGeometryCache.get(),
+                                  &resolved->svgPath);
     }
     else if (loc->type == Spine::Location::BoundingBox)
     {
@@ -1360,7 +2010,13 @@ Spine::LocationPtr QEngineQuery::resolveLocation(const Spine::TaggedLocation& tl
       loc.reset(tmp.release());
     }
 
-    return loc;
+    resolved->loc = loc;
+    resolved->country = itsPlugin.itsEngines.geoEngine->countryName(loc->iso2, query.language);
+    if (!loc->timezone.empty())
+      resolved->tz = state.getTimeZone(loc->timezone);
+
+    state.setResolvedLocation(key, resolved);
+    return resolved;
   }
   catch (...)
   {
@@ -1369,13 +2025,14 @@ Spine::LocationPtr QEngineQuery::resolveLocation(const Spine::TaggedLocation& tl
 }
 
 TS::TimeSeriesGenerator::LocalTimeList QEngineQuery::generateTList(
+    const State& state,
     const Query& query,
     const std::string& producer,
     const ProducerDataPeriod& producerDataPeriod) const
 {
   try
   {
-    auto tz = itsPlugin.itsEngines.geoEngine->getTimeZones().time_zone_from_string(query.timezone);
+    auto tz = state.getTimeZone(query.timezone);
     auto tlist = *itsPlugin.itsTimeSeriesCache->generate(query.toptions, tz);
     bool isClimatologyProducer =
         (producer.empty()
@@ -1386,8 +2043,8 @@ TS::TimeSeriesGenerator::LocalTimeList QEngineQuery::generateTList(
     // except from climatology
     if (!tlist.empty() && !isClimatologyProducer)
     {
-      Fmi::LocalDateTime data_period_endtime = producerDataPeriod.getLocalEndTime(
-          producer, query.timezone, itsPlugin.itsEngines.geoEngine->getTimeZones());
+      Fmi::LocalDateTime data_period_endtime =
+          producerDataPeriod.getLocalEndTime(producer, query.timezone, state);
 
       while (!tlist.empty() && !data_period_endtime.is_not_a_date_time() &&
              *(--tlist.end()) > data_period_endtime)
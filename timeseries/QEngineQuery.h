@@ -9,6 +9,7 @@
 #include "Plugin.h"
 #include "ProducerDataPeriod.h"
 #include "QueryLevelDataCache.h"
+#include "State.h"
 
 namespace SmartMet
 {
@@ -39,17 +40,63 @@ class QEngineQuery
                                              const Query& query,
                                              const AreaProducers& areaproducers) const;
 
+  // Resolve the location once per request, later calls use the table in the State
+  ResolvedLocationPtr resolveLocation(const State& state,
+                                      const Spine::TaggedLocation& tloc,
+                                      const Query& query) const;
+
+  // Number of grid points inside an area, or none if unknown
+  std::optional<std::size_t> countAreaPoints(const State& state,
+                                             const Spine::TaggedLocation& tloc,
+                                             const Query& query,
+                                             const Engine::Querydata::Q& qi) const;
+
  private:
+  // Settings shared by all parameters of a single location
+  struct LocationContext
+  {
+    std::string producer;
+    Engine::Querydata::Q qi;
+    bool isPointQuery = true;
+    bool loadDataLevels = true;
+    std::size_t levelCount = 0;
+    TS::TimeSeriesGenerator::LocalTimeList tlist;
+  };
+
   void resolveAreaLocations(Query& query,
                             const State& state,
                             const AreaProducers& areaproducers) const;
+  void fetchLocationValues(const State& state,
+                           Query& q,
+                           const Spine::TaggedLocation& tloc,
+                           const Fmi::DateTime& first_timestep,
+                           bool firstProducer,
+                           const AreaProducers& areaproducers,
+                           const ProducerDataPeriod& producerDataPeriod,
+                           QueryLevelDataCache& queryLevelDataCache,
+                           TS::OutputData& outputData) const;
+  void prefetchPointValues(const State& state,
+                           const Query& masterquery,
+                           const std::vector<const Spine::TaggedLocation*>& tlocs,
+                           std::size_t first,
+                           std::size_t last,
+                           const Fmi::DateTime& first_timestep,
+                           bool firstProducer,
+                           const AreaProducers& areaproducers,
+                           const ProducerDataPeriod& producerDataPeriod,
+                           std::vector<QueryLevelDataCache>& levelDataCaches) const;
+  bool prepareLocationContext(const State& state,
+                              const Spine::TaggedLocation& tloc,
+                              Query& query,
+                              const AreaProducers& areaproducers,
+                              const ProducerDataPeriod& producerDataPeriod,
+                              LocationContext& context) const;
   void fetchQEngineValues(const State& state,
                           const TS::ParameterAndFunctions& paramfunc,
                           int precision,
                           const Spine::TaggedLocation& tloc,
                           Query& query,
-                          const AreaProducers& areaproducers,
-                          const ProducerDataPeriod& producerDataPeriod,
+                          const LocationContext& context,
                           QueryLevelDataCache& queryLevelDataCache,
                           TS::OutputData& outputData) const;
 
@@ -58,7 +105,8 @@ class QEngineQuery
                           const std::string& producer,
                           const TS::ParameterAndFunctions& paramfunc,
                           const Spine::TaggedLocation& tloc,
-                          const ProducerDataPeriod& producerDataPeriod,
+                          const TS::TimeSeriesGenerator::LocalTimeList& tlist,
+                          const TS::TimeSeriesGenerator::LocalTimeList& querydata_tlist,
                           const Engine::Querydata::Q& qi,
                           double maxdist,
                           int precision,
@@ -72,7 +120,7 @@ class QEngineQuery
                           std::vector<TS::TimeSeriesData>& aggregatedData) const;
 
   TS::TimeSeriesGenerator::LocalTimeList generateQEngineQueryTimes(
-      const Query& query, const std::string& paramname) const;
+      const State& state, const Query& query, const std::string& paramname) const;
 
   void pointQuery(const Query& theQuery,
                   const std::string& theProducer,
@@ -128,23 +176,21 @@ class QEngineQuery
                      std::vector<TS::TimeSeriesData>& theAggregatedData) const;
 
   // Build a location list of the N nearest stations to loc in pointwise querydata theQ
-  Spine::LocationList getNearestStationLocations(const Engine::Querydata::Q& theQ,
+  Spine::LocationList getNearestStationLocations(const State& theState,
+                                                 const Engine::Querydata::Q& theQ,
                                                  const Spine::LocationPtr& loc,
                                                  int numberofstations,
                                                  double theMaxDist) const;
 
-  Spine::LocationPtr resolveLocation(const Spine::TaggedLocation& tloc,
-                                     const Query& query,
-                                     NFmiSvgPath& svgPath,
-                                     bool& isWkt) const;
   TS::TimeSeriesGenerator::LocalTimeList generateTList(
+      const State& state,
       const Query& query,
       const std::string& producer,
       const ProducerDataPeriod& producerDataPeriod) const;
   Spine::LocationList getLocationListForPath(const Query& theQuery,
                                              const Spine::TaggedLocation& theTLoc,
                                              const std::string& place,
-                                             const NFmiSvgPath svgPath,
+                                             const NFmiSvgPath& svgPath,
                                              const State& theState,
                                              bool isWkt) const;
   TS::TimeSeriesGroupPtr getQEngineValuesForArea(
@@ -164,10 +210,11 @@ class QEngineQuery
       const std::string& paramname,
       const Spine::LocationList& llist,
       const std::optional<NFmiPoint>& theDistanceReferencePoint = std::nullopt) const;
-  Spine::LocationList getLocationListForArea(const Spine::TaggedLocation& theTLoc,
+  Spine::LocationList getLocationListForArea(const State& theState,
+                                             const Spine::TaggedLocation& theTLoc,
                                              const Spine::LocationPtr& loc,
                                              const Engine::Querydata::Q& theQ,
-                                             NFmiSvgPath& svgPath,
+                                             std::shared_ptr<const NFmiSvgPath>& svgPath,
                                              bool isWkt) const;
 
   const Plugin& itsPlugin;
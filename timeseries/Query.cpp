@@ -750,6 +750,43 @@ double Query::maxdistance_meters() const
   return Fmi::DistanceParser::parse_meter(maxdistance);
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Save the settings which are modified per location
+ */
+// ----------------------------------------------------------------------
+
+Query::LocationSettings Query::saveLocationSettings() const
+{
+  try
+  {
+    return LocationSettings{timezone, toptions};
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Restore the settings saved before processing a location
+ */
+// ----------------------------------------------------------------------
+
+void Query::restoreLocationSettings(const LocationSettings& theSettings)
+{
+  try
+  {
+    timezone = theSettings.timezone;
+    toptions = theSettings.toptions;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 }  // namespace TimeSeries
 }  // namespace Plugin
 }  // namespace SmartMet
@@ -57,6 +57,7 @@ struct Query : public ObsQueryParams
 
   std::size_t startrow;    // Paging; first (0-) row to return; default 0
   std::size_t maxresults;  // max rows to return (page length); default 0 (all)
+  std::size_t fetchrows = 0;  // rows needed for the requested page; default 0 (all)
 
   std::string wmo;
   std::string fmisid;
@@ -113,6 +114,17 @@ struct Query : public ObsQueryParams
 
   double maxdistance_kilometers() const;
   double maxdistance_meters() const;
+
+  // The settings modified while processing a single location. Saving and restoring
+  // them is much cheaper than processing each location with a copy of the query.
+  struct LocationSettings
+  {
+    std::string timezone;
+    TS::TimeSeriesGeneratorOptions toptions;
+  };
+
+  LocationSettings saveLocationSettings() const;
+  void restoreLocationSettings(const LocationSettings& theSettings);
   // DO NOT FORGET TO CHANGE hash_value IF YOU ADD ANY NEW PARAMETERS
 
  private:
@@ -9,6 +9,9 @@
 
 #pragma once
 
+#include <newbase/NFmiPoint.h>
+#include <optional>
+
 namespace SmartMet
 {
 namespace Plugin
@@ -23,6 +26,9 @@ struct QueryLevelDataCache
 
   ParameterTimeSeriesMap itsTimeSeries;
   ParameterTimeSeriesGroupMap itsTimeSeriesGroups;
+
+  // Point used for the time series fetched in advance for several locations at once
+  std::optional<NFmiPoint> itsLastPoint;
 };
 
 }  // namespace TimeSeries
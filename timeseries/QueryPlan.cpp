@@ -0,0 +1,114 @@
+#include "QueryPlan.h"
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace TimeSeries
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Estimated number of values in the result
+ */
+// ----------------------------------------------------------------------
+
+std::size_t QueryPlan::elements() const
+{
+  std::size_t count = 0;
+  for (const auto& step : steps)
+    count += step.elements;
+  return count;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Estimated number of engine calls
+ */
+// ----------------------------------------------------------------------
+
+std::size_t QueryPlan::calls() const
+{
+  std::size_t count = 0;
+  for (const auto& step : steps)
+    count += step.calls;
+  return count;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief True if the cost of some area could not be estimated
+ */
+// ----------------------------------------------------------------------
+
+bool QueryPlan::unknownCost() const
+{
+  for (const auto& step : steps)
+    if (step.area && !step.points)
+      return true;
+  return false;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Output the plan with one row per step and a final row for totals
+ */
+// ----------------------------------------------------------------------
+
+void QueryPlan::fill_table(Spine::Table& table, Spine::TableFormatter::Names& headers) const
+{
+  try
+  {
+    headers = {"group",
+               "engine",
+               "producer",
+               "location",
+               "type",
+               "points",
+               "timesteps",
+               "levels",
+               "parameters",
+               "elements",
+               "calls"};
+
+    std::size_t row = 0;
+    for (const auto& step : steps)
+    {
+      std::size_t column = 0;
+      table.set(column++, row, Fmi::to_string(step.group));
+      table.set(column++, row, step.engine);
+      table.set(column++, row, step.producer);
+      table.set(column++, row, step.location);
+      if (!step.area)
+        table.set(column++, row, "point");
+      else if (step.points)
+        table.set(column++, row, "area");
+      else
+        table.set(column++, row, "area, cost unknown");
+      table.set(column++, row, step.points ? Fmi::to_string(*step.points) : "");
+      table.set(column++, row, Fmi::to_string(step.timesteps));
+      table.set(column++, row, Fmi::to_string(step.levels));
+      table.set(column++, row, Fmi::to_string(step.parameters));
+      table.set(column++, row, Fmi::to_string(step.elements));
+      table.set(column++, row, Fmi::to_string(step.calls));
+      ++row;
+    }
+
+    // Every cell is set so that the output does not depend on the missing value text
+    for (std::size_t column = 0; column < headers.size(); column++)
+      table.set(column, row, "");
+    table.set(0, row, "total");
+    table.set(4, row, unknownCost() ? "cost unknown" : "");
+    table.set(9, row, Fmi::to_string(elements()));
+    table.set(10, row, Fmi::to_string(calls()));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace TimeSeries
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,63 @@
+// ======================================================================
+/*!
+ * \brief Execution plan of a request
+ *
+ * The plan lists for each producer group and location the engine which
+ * would handle it, the time steps, levels, points and parameters, and
+ * the estimated number of values and engine calls. The values of areas
+ * are counted for every point inside, since they are all fetched even if
+ * the area is aggregated into a single value. If the number of points is
+ * not known without fetching the data, the cost is marked unknown. It is built without
+ * fetching any data, and is returned by format=explain.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <spine/Table.h>
+#include <spine/TableFormatter.h>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace TimeSeries
+{
+struct QueryPlan
+{
+  struct Step
+  {
+    std::size_t group = 0;  // producer group
+    std::string engine;     // querydata, observation or grid
+    std::string producer;
+    std::string location;
+    bool area = false;                  // values of areas depend on the number of points inside
+    std::optional<std::size_t> points;  // points or stations, unknown for some areas
+    std::size_t timesteps = 0;
+    std::size_t levels = 0;
+    std::size_t parameters = 0;
+    std::size_t elements = 0;
+    std::size_t calls = 0;
+  };
+
+  std::vector<Step> steps;
+
+  // Totals of the request
+  std::size_t elements() const;
+  std::size_t calls() const;
+
+  // True if the cost of some area could not be estimated
+  bool unknownCost() const;
+
+  void fill_table(Spine::Table& table, Spine::TableFormatter::Names& headers) const;
+};
+
+}  // namespace TimeSeries
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
@@ -7,8 +7,10 @@
 #include "State.h"
 #include <grid-files/common/GeneralFunctions.h>
 #include <macgyver/Hash.h>
+#include <macgyver/StringConversion.h>
 #include <timeseries/ParameterKeywords.h>
 #include <timeseries/ParameterTools.h>
+#include <algorithm>
 
 namespace SmartMet
 {
@@ -61,45 +63,6 @@ bool obs_producers_exists(const Query& masterquery, ObsEngineQuery obsEngineQuer
 }
 #endif
 
-Spine::LocationPtr get_loc(const Query& masterquery,
-                           const Query q,
-                           const Spine::TaggedLocation& tloc,
-                           const Engine::Geonames::Engine& geoEngine,
-                           const Engine::Gis::GeometryStorage& geometryStorage)
-{
-  try
-  {
-    Spine::LocationPtr loc = tloc.loc;
-
-    std::string place = get_name_base(loc->name);
-    if (loc->type == Spine::Location::Wkt)
-    {
-      loc = masterquery.wktGeometries.getLocation(tloc.loc->name);
-    }
-    else if (loc->type == Spine::Location::Path || loc->type == Spine::Location::Area)
-    {
-      NFmiSvgPath svgPath;
-      loc = get_location_for_area(tloc, geometryStorage, q.language, geoEngine, &svgPath);
-    }
-    else if (loc->type == Spine::Location::BoundingBox)
-    {
-      // get location info for center coordinates
-      std::unique_ptr<Spine::Location> tmp = get_bbox_location(place, q.language, geoEngine);
-
-      tmp->name = tloc.tag;
-      tmp->type = tloc.loc->type;
-      tmp->radius = tloc.loc->radius;
-      loc.reset(tmp.release());
-    }
-
-    return loc;
-  }
-  catch (...)
-  {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
-}
-
 Spine::LocationPtr get_nearest_loc(const Query& masterquery, const Spine::TaggedLocation& tloc)
 {
   try
@@ -137,7 +100,8 @@ Spine::LocationPtr get_nearest_loc(const Query& masterquery, const Spine::Tagged
 
 Spine::TaggedLocationList get_tloc_list(const Query& masterquery,
                                         const Spine::TaggedLocation& tloc,
-                                        const Engine::Gis::GeometryStorage& geometryStorage)
+                                        const Engine::Gis::GeometryStorage& geometryStorage,
+                                        GeometryCache* geometryCache)
 {
   try
   {
@@ -172,7 +136,7 @@ Spine::TaggedLocationList get_tloc_list(const Query& masterquery,
                          Fmi::to_string(bbox.xMax) + " " + Fmi::to_string(bbox.yMax) + "," +
                          Fmi::to_string(bbox.xMax) + " " + Fmi::to_string(bbox.yMin) + "," +
                          Fmi::to_string(bbox.xMin) + " " + Fmi::to_string(bbox.yMin) + "))");
-      std::unique_ptr<OGRGeometry> geom = get_ogr_geometry(wkt);
+      auto geom = get_shared_ogr_geometry(wkt, 0.0, geometryCache);
       if (geom)
         return get_locations_inside_geometry(masterquery.inKeywordLocations, *geom);
 
@@ -201,7 +165,7 @@ Spine::TaggedLocationList get_tloc_list(const Query& masterquery,
         wkt += " ";
         wkt += Fmi::to_string(tloc.loc->latitude);
         wkt += ")";
-        std::unique_ptr<OGRGeometry> geom = get_ogr_geometry(wkt, tloc.loc->radius);
+        auto geom = get_shared_ogr_geometry(wkt, tloc.loc->radius, geometryCache);
         if (geom)
           return get_locations_inside_geometry(masterquery.inKeywordLocations, *geom);
       }
@@ -216,7 +180,8 @@ Spine::TaggedLocationList get_tloc_list(const Query& masterquery,
 }
 
 void check_in_keyword_locations(Query& masterquery,
-                                const Engine::Gis::GeometryStorage& geometryStorage)
+                                const Engine::Gis::GeometryStorage& geometryStorage,
+                                GeometryCache* geometryCache)
 {
   try
   {
@@ -226,7 +191,7 @@ void check_in_keyword_locations(Query& masterquery,
       Spine::TaggedLocationList tloc_list;
       for (const auto& tloc : masterquery.loptions->locations())
       {
-        auto tlocs = get_tloc_list(masterquery, tloc, geometryStorage);
+        auto tlocs = get_tloc_list(masterquery, tloc, geometryStorage, geometryCache);
         tloc_list.insert(tloc_list.end(), tlocs.begin(), tlocs.end());
       }
       masterquery.loptions->setLocations(tloc_list);
@@ -302,26 +267,26 @@ QueryProcessingHub::QueryProcessingHub(const Plugin& thePlugin)
 {
 }
 
-std::shared_ptr<std::string> QueryProcessingHub::processQuery(
-    const State& state,
-    Spine::Table& table,
-    Query& masterquery,
-    const QueryServer::QueryStreamer_sptr& queryStreamer,
-    size_t& product_hash)
+void QueryProcessingHub::processQuery(const State& state,
+                                      Spine::Table& table,
+                                      Query& masterquery,
+                                      const QueryServer::QueryStreamer_sptr& queryStreamer,
+                                      size_t& product_hash)
 {
   try
   {
     const auto& thePlugin = state.getPlugin();
     const auto& theEngines = thePlugin.itsEngines;
 
-    check_in_keyword_locations(masterquery, thePlugin.itsGeometryStorage);
+    check_in_keyword_locations(
+        masterquery, thePlugin.itsGeometryStorage, thePlugin.itsGeometryCache.get());
 
     // if only location related parameters queried, use shortcut
     if (is_static_location_query(masterquery.poptions.parameters()))
     {
       fetch_static_location_values(
           masterquery, *theEngines.geoEngine, thePlugin.itsGeometryStorage, table);
-      return {};
+      return;
     }
 
     ProducerDataPeriod producerDataPeriod;
@@ -345,6 +310,11 @@ std::shared_ptr<std::string> QueryProcessingHub::processQuery(
     const ObsParameters obsParameters = itsObsEngineQuery.getObsParameters(masterquery);
 #endif
 
+    // With a single producer group the rows up to the end of the requested page
+    // are final once produced, and fetching more locations can be stopped
+    if (masterquery.maxresults > 0 && masterquery.timeproducers.size() == 1)
+      masterquery.fetchrows = masterquery.startrow + masterquery.maxresults;
+
     Fmi::DateTime latestTimestep = masterquery.latestTimestep;
     bool startTimeUTC = masterquery.toptions.startTimeUTC;
 
@@ -408,9 +378,8 @@ std::shared_ptr<std::string> QueryProcessingHub::processQuery(
 #endif
 
     // insert data into the table
+    TraceSpan span(state, "fill_table");
     PostProcessing::fill_table(masterquery, outputData, table);
-
-    return nullptr;
   }
   catch (...)
   {
@@ -422,8 +391,8 @@ std::shared_ptr<std::string> QueryProcessingHub::processQuery(
 /*!
  * \brief Calculate a hash value for the query
  *
- * A zero value implies the product cannot be cached, for example because
- * it uses observations.
+ * Fmi::bad_hash implies the product cannot be cached, for example because
+ * it uses observations or the grid engine.
  *
  * The hash value includes all query options, the querydata selected
  * for the locations, plus the time series generated for the locations.
@@ -456,7 +425,7 @@ std::shared_ptr<std::string> QueryProcessingHub::processQuery(
 // ----------------------------------------------------------------------
 std::size_t QueryProcessingHub::hash_value(const State& state,
                                            const Spine::HTTP::Request& request,
-                                           Query masterquery) const
+                                           const Query& masterquery) const
 {
   try
   {
@@ -503,55 +472,46 @@ std::size_t QueryProcessingHub::hash_value(const State& state,
     producerDataPeriod.init(state, *thePlugin.itsEngines.qEngine, masterquery.timeproducers);
 #endif
 
-    // the result data is stored here during the query
-
-    bool producerMissing = (masterquery.timeproducers.empty());
-
-    if (producerMissing)
-    {
-      masterquery.timeproducers.emplace_back(AreaProducers());
-    }
-
-    Fmi::DateTime latestTimestep = masterquery.latestTimestep;
+    // Without producers the default producer is used
 
-    bool startTimeUTC = masterquery.toptions.startTimeUTC;
+    const TimeProducers default_producers(1);
+    const auto& timeproducers =
+        (masterquery.timeproducers.empty() ? default_producers : masterquery.timeproducers);
 
-    // This loop will iterate through the producers.
+    // This loop will iterate through the producers. No data is fetched, hence
+    // the latest timestep and the time options stay as in the master query,
+    // and only the settings modified per location are copied.
 
-    std::size_t producer_group = 0;
+    const Query& q = masterquery;
     bool firstProducer = true;
 
-    for (const AreaProducers& areaproducers : masterquery.timeproducers)
+    for (const AreaProducers& areaproducers : timeproducers)
     {
-      Query q = masterquery;
-
-      q.timeproducers.clear();  // not used
-      // set latestTimestep for the query
-      q.latestTimestep = latestTimestep;
-
-      if (producer_group != 0)
-        q.toptions.startTimeUTC = startTimeUTC;
-      q.toptions.endTimeUTC = masterquery.toptions.endTimeUTC;
-
 #ifndef WITHOUT_OBSERVATION
       if (!areaproducers.empty() && !thePlugin.itsConfig.obsEngineDisabled() &&
           itsObsEngineQuery.isObsProducer(areaproducers.front()))
       {
         // Cannot cache observations! Safety check only, this has already been checked at the start
-        return 0;
+        return Fmi::bad_hash;
       }
       else
 #endif
+          if (itsGridEngineQuery.isGridEngineQuery(areaproducers, masterquery))
+      {
+        // We need different hash calculations for the grid requests
+        return Fmi::bad_hash;
+      }
+      else
       {
         // Here we emulate processQEngineQuery
         // Note name changes: masterquery --> query, and query-->subquery
 
         // first timestep is here in utc
-        Fmi::DateTime first_timestep = q.latestTimestep;
+        const Fmi::DateTime& first_timestep = q.latestTimestep;
 
         for (const auto& tloc : q.loptions->locations())
         {
-          Query subquery = q;
+          Query::LocationSettings subquery = q.saveLocationSettings();
 
           if (subquery.timezone == LOCALTIME_PARAM)
             subquery.timezone = tloc.loc->timezone;
@@ -563,15 +523,14 @@ std::size_t QueryProcessingHub::hash_value(const State& state,
           firstProducer = false;
 
           // producer can be alias, get actual producer
-          std::string producer(
-              itsQEngineQuery.selectProducer(*(tloc.loc), subquery, areaproducers));
+          std::string producer(itsQEngineQuery.selectProducer(*(tloc.loc), q, areaproducers));
           bool isClimatologyProducer =
               (producer.empty()
                    ? false
                    : thePlugin.itsEngines.qEngine->getProducerConfig(producer).isclimatology);
 
-          Fmi::LocalDateTime data_period_endtime(producerDataPeriod.getLocalEndTime(
-              producer, subquery.timezone, thePlugin.getTimeZones()));
+          Fmi::LocalDateTime data_period_endtime(
+              producerDataPeriod.getLocalEndTime(producer, subquery.timezone, state));
 
           // We do not need to iterate over the parameters here like processQEngineQuery does
 
@@ -585,17 +544,14 @@ std::size_t QueryProcessingHub::hash_value(const State& state,
 
           {
             // Emulate fetchQEngineValues here
-            Spine::LocationPtr loc = get_loc(masterquery,
-                                             q,
-                                             tloc,
-                                             *thePlugin.itsEngines.geoEngine,
-                                             thePlugin.itsGeometryStorage);
+            const auto resolved = itsQEngineQuery.resolveLocation(state, tloc, q);
+            const auto& loc = resolved->loc;
 
             if (subquery.timezone == LOCALTIME_PARAM)
               subquery.timezone = loc->timezone;
 
             // Select the producer for the coordinate
-            producer = itsQEngineQuery.selectProducer(*loc, subquery, areaproducers);
+            producer = itsQEngineQuery.selectProducer(*loc, q, areaproducers);
 
             if (producer.empty())
             {
@@ -604,8 +560,7 @@ std::size_t QueryProcessingHub::hash_value(const State& state,
               throw ex;
             }
 
-            auto qi = (subquery.origintime ? state.get(producer, *subquery.origintime)
-                                           : state.get(producer));
+            auto qi = (q.origintime ? state.get(producer, *q.origintime) : state.get(producer));
 
             // Generated timeseries may depend on the available querydata
             auto querydata_hash = Engine::Querydata::hash_value(qi);
@@ -634,9 +589,9 @@ std::size_t QueryProcessingHub::hash_value(const State& state,
                                     ((loc->type == Spine::Location::Place ||
                                       loc->type == Spine::Location::CoordinatePoint) &&
                                      loc->radius > 0)))
-                return 0;
+                return Fmi::bad_hash;
 
-              auto tz = thePlugin.getTimeZones().time_zone_from_string(subquery.timezone);
+              auto tz = state.getTimeZone(subquery.timezone);
               auto tlist = thePlugin.itsTimeSeriesCache->generate(subquery.toptions, tz);
 
               // This is enough to generate an unique hash for the request, even
@@ -647,21 +602,187 @@ std::size_t QueryProcessingHub::hash_value(const State& state,
               Fmi::hash_combine(hash, Fmi::hash_value(*tlist));
             }
           }
+        }
+      }
+    }
+
+    return hash;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Build the execution plan of the query
+ *
+ * The producer groups are routed to the engines the same way as in
+ * processQuery. For querydata the producer, the time steps and the levels
+ * are resolved for each location, which requires only the metadata of
+ * the data. Areas of grid data are costed by the number of grid points
+ * inside them. Observation areas, keyword and bounding box searches, and
+ * areas of grid engine and station data are marked to be of unknown cost
+ * since the number of stations or points is known only once fetched.
+ */
+// ----------------------------------------------------------------------
 
-          // get the latest_timestep from previous query
-          q.latestTimestep = subquery.latestTimestep;
-          q.lastpoint = subquery.lastpoint;
+QueryPlan QueryProcessingHub::explainQuery(const State& state, const Query& masterquery) const
+{
+  try
+  {
+    QueryPlan plan;
+
+    const auto& thePlugin = state.getPlugin();
+    const std::size_t nparams = masterquery.poptions.parameterFunctions().size();
+    const std::size_t nlevels =
+        masterquery.levels.size() + masterquery.pressures.size() + masterquery.heights.size();
+
+    ProducerDataPeriod producerDataPeriod;
+#ifndef WITHOUT_OBSERVATION
+    producerDataPeriod.init(state,
+                            *thePlugin.itsEngines.qEngine,
+                            thePlugin.itsEngines.obsEngine.get(),
+                            masterquery.timeproducers);
+#else
+    producerDataPeriod.init(state, *thePlugin.itsEngines.qEngine, masterquery.timeproducers);
+#endif
+
+    // Without producers the default producer is used
+    const TimeProducers default_producers(1);
+    const auto& timeproducers =
+        (masterquery.timeproducers.empty() ? default_producers : masterquery.timeproducers);
+
+    std::size_t producer_group = 0;
+    for (const AreaProducers& areaproducers : timeproducers)
+    {
+      QueryPlan::Step group_step;
+      group_step.group = producer_group++;
+      group_step.parameters = nparams;
+      for (const auto& producer : areaproducers)
+        group_step.producer += (group_step.producer.empty() ? "" : ",") + producer;
+
+#ifndef WITHOUT_OBSERVATION
+      if (!areaproducers.empty() && !thePlugin.itsConfig.obsEngineDisabled() &&
+          itsObsEngineQuery.isObsProducer(areaproducers.front()))
+      {
+        // All stations are fetched with one call. Areas, keywords and bounding boxes
+        // cover an unknown number of stations.
+        QueryPlan::Step step = group_step;
+        step.engine = "observation";
+        const std::size_t nlocations = masterquery.loptions->locations().size() +
+                                       masterquery.fmisids.size() + masterquery.wmos.size() +
+                                       masterquery.lpnns.size();
+        step.location = Fmi::to_string(nlocations) + " locations";
+        step.area = (!masterquery.keyword.empty() || !masterquery.boundingBox.empty());
+        for (const auto& tloc : masterquery.loptions->locations())
+          step.area = step.area || ((tloc.loc->type != Spine::Location::Place &&
+                                     tloc.loc->type != Spine::Location::CoordinatePoint) ||
+                                    tloc.loc->radius > 0);
+        if (!step.area)
+          step.points = nlocations;
+        if (!masterquery.toptions.all())
+        {
+          auto tz = state.getTimeZone(
+              masterquery.timezone == LOCALTIME_PARAM ? "UTC" : masterquery.timezone);
+          step.timesteps = thePlugin.itsTimeSeriesCache->generate(masterquery.toptions, tz)->size();
         }
+        step.levels = 1;
+        step.elements = nlocations * nparams * step.timesteps;
+        step.calls = 1;
+        plan.steps.push_back(step);
+        continue;
       }
+#endif
 
-      // get the latestTimestep from previous query
-      latestTimestep = q.latestTimestep;
+      const bool grid = itsGridEngineQuery.isGridEngineQuery(areaproducers, masterquery);
 
-      startTimeUTC = q.toptions.startTimeUTC;
-      ++producer_group;
+      for (const auto& tloc : masterquery.loptions->locations())
+      {
+        QueryPlan::Step step = group_step;
+        step.engine = (grid ? "grid" : "querydata");
+        step.location = (tloc.tag.empty() ? tloc.loc->name : tloc.tag);
+
+        const auto resolved = itsQEngineQuery.resolveLocation(state, tloc, masterquery);
+        const auto& loc = resolved->loc;
+        step.area = ((loc->type != Spine::Location::Place &&
+                      loc->type != Spine::Location::CoordinatePoint) ||
+                     loc->radius > 0);
+        if (!step.area)
+          step.points = 1;
+
+        auto settings = masterquery.saveLocationSettings();
+        if (settings.timezone == LOCALTIME_PARAM)
+          settings.timezone = loc->timezone;
+        settings.toptions.startTime = masterquery.latestTimestep;
+
+        if (grid)
+        {
+          // One grid query per level, each containing all the parameters. The grid
+          // engine resolves the points of areas, hence their cost is unknown.
+          auto tz = state.getTimeZone(settings.timezone);
+          step.timesteps = thePlugin.itsTimeSeriesCache->generate(settings.toptions, tz)->size();
+          step.levels = std::max<std::size_t>(nlevels, 1);
+          step.elements = nparams * step.levels * step.timesteps;
+          step.calls = step.levels;
+          plan.steps.push_back(step);
+          continue;
+        }
+
+        const auto producer = itsQEngineQuery.selectProducer(*loc, masterquery, areaproducers);
+        step.producer = producer;
+        if (producer.empty())
+        {
+          // No data for the location
+          plan.steps.push_back(step);
+          continue;
+        }
+
+        auto qi = (masterquery.origintime ? state.get(producer, *masterquery.origintime)
+                                          : state.get(producer));
+
+        bool isClimatologyProducer =
+            thePlugin.itsEngines.qEngine->getProducerConfig(producer).isclimatology;
+        Fmi::LocalDateTime data_period_endtime(
+            producerDataPeriod.getLocalEndTime(producer, settings.timezone, state));
+        if (!data_period_endtime.is_not_a_date_time() &&
+            settings.toptions.endTime > data_period_endtime.local_time() && !isClimatologyProducer)
+          settings.toptions.endTime = data_period_endtime.local_time();
+
+        const auto validtimes = qi->validTimes();
+        if (validtimes && !validtimes->empty())
+        {
+          settings.toptions.setDataTimes(validtimes, qi->isClimatology());
+          auto tz = state.getTimeZone(settings.timezone);
+          step.timesteps = thePlugin.itsTimeSeriesCache->generate(settings.toptions, tz)->size();
+        }
+
+        // Data levels are loaded unless only pressures or heights are requested
+        step.levels = masterquery.pressures.size() + masterquery.heights.size();
+        if (!masterquery.levels.empty() ||
+            (masterquery.pressures.empty() && masterquery.heights.empty()))
+        {
+          for (qi->resetLevel(); qi->nextLevel();)
+          {
+            int level = static_cast<int>(qi->levelValue());
+            if (masterquery.levels.empty() ||
+                masterquery.levels.find(level) != masterquery.levels.end())
+              ++step.levels;
+          }
+        }
+
+        // All the grid points of an area are fetched
+        if (step.area)
+          step.points = itsQEngineQuery.countAreaPoints(state, tloc, masterquery, qi);
+
+        step.elements = nparams * step.levels * step.timesteps * step.points.value_or(0);
+        step.calls = nparams * step.levels;
+        plan.steps.push_back(step);
+      }
     }
 
-    return hash;
+    return plan;
   }
   catch (...)
   {
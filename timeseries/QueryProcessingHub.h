@@ -10,6 +10,7 @@
 #include "ObsEngineQuery.h"
 #include "Plugin.h"
 #include "QEngineQuery.h"
+#include "QueryPlan.h"
 #include <spine/HTTP.h>
 
 namespace SmartMet
@@ -23,15 +24,18 @@ class QueryProcessingHub
  public:
   QueryProcessingHub(const Plugin& thePlugin);
 
-  std::shared_ptr<std::string> processQuery(const State& state,
-                                              Spine::Table& table,
-                                              Query& masterquery,
-                                              const QueryServer::QueryStreamer_sptr& queryStreamer,
-                                              size_t& product_hash);
+  void processQuery(const State& state,
+                    Spine::Table& table,
+                    Query& masterquery,
+                    const QueryServer::QueryStreamer_sptr& queryStreamer,
+                    size_t& product_hash);
 
   std::size_t hash_value(const State& state,
                          const Spine::HTTP::Request& request,
-                         Query masterquery) const;
+                         const Query& masterquery) const;
+
+  // Build the execution plan of the query without fetching any data
+  QueryPlan explainQuery(const State& state, const Query& masterquery) const;
 
  private:
   QEngineQuery itsQEngineQuery;
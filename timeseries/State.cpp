@@ -12,6 +12,12 @@ namespace Plugin
 {
 namespace TimeSeries
 {
+namespace
+{
+// Enough for the grid point locations of a typical area request
+const std::size_t InitialArenaSize = 64 * 1024;
+}  // namespace
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Initialize'the query state object
@@ -20,7 +26,10 @@ namespace TimeSeries
 
 State::State(const Plugin& thePlugin)
     : itsPlugin(thePlugin),
-      itsTime(Fmi::SecondClock::universal_time())
+      itsTime(Fmi::SecondClock::universal_time()),
+      itsArena(InitialArenaSize),
+      itsMemory(&itsArena),
+      itsThreadId(std::this_thread::get_id())
 {
 }
 
@@ -164,18 +173,22 @@ Engine::Querydata::Q State::get(const Engine::Querydata::Producer& theProducer)
 {
   try
   {
-    // Use cached result if there is one
-    auto res = itsQCache.find(theProducer);
-    if (res != itsQCache.end())
-      return res->second;
-
-    // Get the data from the engine
-    auto q = itsPlugin.getEngines().qEngine->get(theProducer);
+    Engine::Querydata::Q q;
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
 
-    // Cache the obtained data and return it. The cache is
-    // request specific, no need for mutexes here.
-    itsQCache[theProducer] = q;
-    return q;
+      // Use cached result if there is one
+      auto res = itsQCache.find(theProducer);
+      if (res != itsQCache.end())
+        q = res->second;
+      else
+      {
+        // Get the data from the engine and cache it
+        q = itsPlugin.getEngines().qEngine->get(theProducer);
+        itsQCache[theProducer] = q;
+      }
+    }
+    return forThisThread(theProducer, q);
   }
   catch (...)
   {
@@ -194,28 +207,191 @@ Engine::Querydata::Q State::get(const Engine::Querydata::Producer& theProducer,
 {
   try
   {
-    // Use cached result if there is one
-    auto res = itsTimedQCache.find(theOriginTime);
-    if (res != itsTimedQCache.end())
+    Engine::Querydata::Q q;
     {
-      auto res2 = res->second.find(theProducer);
-      if (res2 != res->second.end())
-        return res2->second;
+      std::lock_guard<std::mutex> lock(itsMutex);
+
+      // Use cached result if there is one
+      auto res = itsTimedQCache.find(theOriginTime);
+      if (res != itsTimedQCache.end())
+      {
+        auto res2 = res->second.find(theProducer);
+        if (res2 != res->second.end())
+          q = res2->second;
+      }
+
+      if (!q)
+      {
+        // Get the data from the engine and cache it
+        q = itsPlugin.getEngines().qEngine->get(theProducer, theOriginTime);
+        itsTimedQCache[theOriginTime][theProducer] = q;
+      }
     }
+    return forThisThread(theProducer, q);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Failed to get querydata for the requested origintime")
+        .disableStackTrace();
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get a handle to the given querydata usable in the current thread
+ *
+ * Worker threads get their own handle to the same model run, since the
+ * handles contain iterator state. Q has no copy operation, a new handle
+ * for the origin time of the existing one is the clone. The engine is
+ * called without holding the mutex.
+ */
+// ----------------------------------------------------------------------
 
-    // Get the data from the engine
-    auto q = itsPlugin.getEngines().qEngine->get(theProducer, theOriginTime);
+Engine::Querydata::Q State::forThisThread(const Engine::Querydata::Producer& theProducer,
+                                          const Engine::Querydata::Q& theQ) const
+{
+  try
+  {
+    const auto thread_id = std::this_thread::get_id();
+    if (thread_id == itsThreadId)
+      return theQ;
 
-    // Cache the obtained data and return it. The cache is
-    // request specific, no need for mutexes here.
+    const auto key = std::make_pair(thread_id, static_cast<const void*>(theQ.get()));
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+      auto pos = itsWorkerQCache.find(key);
+      if (pos != itsWorkerQCache.end())
+        return pos->second;
+    }
+
+    auto q = itsPlugin.getEngines().qEngine->get(theProducer, theQ->originTime());
 
-    itsTimedQCache[theOriginTime][theProducer] = q;
+    std::lock_guard<std::mutex> lock(itsMutex);
+    itsWorkerQCache.insert(std::make_pair(key, q));
     return q;
   }
   catch (...)
   {
-    throw Fmi::Exception::Trace(BCP, "Failed to get querydata for the requested origintime")
-        .disableStackTrace();
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get a previously resolved location, or nullptr if there is none
+ */
+// ----------------------------------------------------------------------
+
+ResolvedLocationPtr State::getResolvedLocation(const std::string& theKey) const
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    auto pos = itsResolvedLocations.find(theKey);
+    if (pos == itsResolvedLocations.end())
+      return {};
+    return pos->second;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Store a resolved location for later stages of the request
+ */
+// ----------------------------------------------------------------------
+
+void State::setResolvedLocation(const std::string& theKey,
+                                const ResolvedLocationPtr& theLocation) const
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    itsResolvedLocations[theKey] = theLocation;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get a time zone by name
+ *
+ * Fmi::TimeZones::time_zone_from_string takes a lock on a shared cache,
+ * hence the time zones are resolved only once per request.
+ */
+// ----------------------------------------------------------------------
+
+Fmi::TimeZonePtr State::getTimeZone(const std::string& theName) const
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    auto pos = itsTimeZones.find(theName);
+    if (pos != itsTimeZones.end())
+      return pos->second;
+
+    auto tz = getTimeZones().time_zone_from_string(theName);
+    itsTimeZones.insert(std::make_pair(theName, tz));
+    return tz;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Add fetched values to the request total
+ */
+// ----------------------------------------------------------------------
+
+std::size_t State::addElements(std::size_t theCount) const
+{
+  return itsElementCount += theCount;
+}
+
+std::size_t State::getElementCount() const
+{
+  return itsElementCount;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Return the trace of the processing stages
+ */
+// ----------------------------------------------------------------------
+
+Trace& State::getTrace() const
+{
+  return itsTrace;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Allocate a location from the request arena
+ *
+ * The location must not be stored anywhere outliving the request, such
+ * as the process wide caches of the plugin.
+ */
+// ----------------------------------------------------------------------
+
+Spine::LocationPtr State::makeLocation(const Spine::Location& theLocation) const
+{
+  try
+  {
+    return std::allocate_shared<Spine::Location>(
+        std::pmr::polymorphic_allocator<Spine::Location>(&itsMemory), theLocation);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
   }
 }
 
@@ -10,17 +10,34 @@
  * so that the results may be cached. This is not for speed, but
  * to make sure the same selection is made again if needed.
  *
- * Note that in general there are no thread safety issues since the
- * object is query specific.
+ * The object is query specific, but locations of a single query may
+ * be processed in parallel. Hence the caches are protected by a mutex,
+ * and each worker thread gets its own querydata handle for the same
+ * model run, since the handles contain iterator state.
+ *
+ * The many small locations generated for the grid points of areas and
+ * for stations are allocated from a request specific arena, which is
+ * released at once when the request ends. The arena is thread safe so
+ * that parallel workers can share it.
  */
 // ======================================================================
 
 #pragma once
+#include "Tracing.h"
 #include <macgyver/DateTime.h>
 #include <engines/querydata/OriginTime.h>
 #include <engines/querydata/Producer.h>
 #include <engines/querydata/Q.h>
+#include <newbase/NFmiSvgPath.h>
+#include <spine/Location.h>
 #include <timeseries/TimeSeriesInclude.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <thread>
 
 namespace Fmi
 {
@@ -59,6 +76,18 @@ namespace TimeSeries
 {
 class Plugin;
 
+// A location resolved once for the duration of the request
+struct ResolvedLocation
+{
+  Spine::LocationPtr loc;                      // location for areas, paths, bounding boxes and WKTs
+  std::shared_ptr<const NFmiSvgPath> svgPath;  // the shared geometry of areas and WKTs
+  bool isWkt = false;
+  std::string country;                         // country name in the requested language
+  Fmi::TimeZonePtr tz;                         // time zone of the resolved location, if known
+};
+
+using ResolvedLocationPtr = std::shared_ptr<const ResolvedLocation>;
+
 class State
 {
  public:
@@ -91,10 +120,35 @@ class State
   Engine::Querydata::Q get(const Engine::Querydata::Producer& theProducer,
                            const Engine::Querydata::OriginTime& theOriginTime) const;
 
+  // Resolved locations, the key must identify the tagged location uniquely
+  ResolvedLocationPtr getResolvedLocation(const std::string& theKey) const;
+  void setResolvedLocation(const std::string& theKey, const ResolvedLocationPtr& theLocation) const;
+
+  // Time zone by name, resolved only once per request
+  Fmi::TimeZonePtr getTimeZone(const std::string& theName) const;
+
+  // Running count of the values fetched for the request, returns the new total
+  std::size_t addElements(std::size_t theCount) const;
+  std::size_t getElementCount() const;
+
+  // Durations of the processing stages of the request
+  Trace& getTrace() const;
+
+  // Location allocated from the request arena, valid only during the request
+  Spine::LocationPtr makeLocation(const Spine::Location& theLocation) const;
+
  private:
   const Plugin& itsPlugin;
   Fmi::DateTime itsTime;
 
+  // Request arena, declared before the tables so that it outlives their contents
+  mutable std::pmr::monotonic_buffer_resource itsArena;
+  mutable std::pmr::synchronized_pool_resource itsMemory;
+
+  // Protects the caches when locations are processed in parallel
+  mutable std::mutex itsMutex;
+  const std::thread::id itsThreadId;
+
   // Querydata caches - always make the same choice for same locations and producers
   using QCache = std::map<Engine::Querydata::Producer, Engine::Querydata::Q>;
   using TimedQCache = std::map<Engine::Querydata::OriginTime, QCache>;
@@ -102,6 +156,25 @@ class State
   mutable QCache itsQCache;
   mutable TimedQCache itsTimedQCache;
 
+  // Worker thread specific handles to the same data as in the caches above
+  using WorkerQCache = std::map<std::pair<std::thread::id, const void*>, Engine::Querydata::Q>;
+  mutable WorkerQCache itsWorkerQCache;
+
+  Engine::Querydata::Q forThisThread(const Engine::Querydata::Producer& theProducer,
+                                     const Engine::Querydata::Q& theQ) const;
+
+  // Location cache - resolve each location only once
+  mutable std::map<std::string, ResolvedLocationPtr> itsResolvedLocations;
+
+  // Time zone cache - avoid locking the global time zone cache repeatedly
+  mutable std::map<std::string, Fmi::TimeZonePtr> itsTimeZones;
+
+  // Number of values fetched so far, checked against the request limits
+  mutable std::atomic<std::size_t> itsElementCount{0};
+
+  // Spans of the processing stages, the trace has its own mutex
+  mutable Trace itsTrace;
+
 };  // class State
 
 }  // namespace TimeSeries
@@ -0,0 +1,107 @@
+#include "TaskPool.h"
+#include <macgyver/Exception.h>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace TimeSeries
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Start the threads
+ */
+// ----------------------------------------------------------------------
+
+TaskPool::TaskPool(std::size_t theThreads, std::size_t theMaxQueued) : itsMaxQueued(theMaxQueued)
+{
+  try
+  {
+    itsThreads.reserve(theThreads);
+    for (std::size_t i = 0; i < theThreads; i++)
+      itsThreads.emplace_back([this] { run(); });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Stop the threads, jobs still in the queue are not run
+ */
+// ----------------------------------------------------------------------
+
+TaskPool::~TaskPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    itsStopping = true;
+    itsJobs.clear();
+  }
+  itsCondition.notify_all();
+
+  for (auto& thread : itsThreads)
+    thread.join();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Queue a job unless the queue is full
+ */
+// ----------------------------------------------------------------------
+
+bool TaskPool::submit(std::function<void()> theJob)
+{
+  try
+  {
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+      if (itsStopping || itsThreads.empty() || itsJobs.size() >= itsMaxQueued)
+        return false;
+      itsJobs.push_back(std::move(theJob));
+    }
+    itsCondition.notify_one();
+    return true;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Run jobs until the pool is stopped
+ */
+// ----------------------------------------------------------------------
+
+void TaskPool::run()
+{
+  while (true)
+  {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(itsMutex);
+      itsCondition.wait(lock, [this] { return itsStopping || !itsJobs.empty(); });
+      if (itsStopping)
+        return;
+      job = std::move(itsJobs.front());
+      itsJobs.pop_front();
+    }
+
+    try
+    {
+      job();
+    }
+    catch (...)
+    {
+      // The jobs report their own errors to the submitter
+    }
+  }
+}
+
+}  // namespace TimeSeries
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,56 @@
+// ======================================================================
+/*!
+ * \brief Process wide pool of threads for the parallel parts of requests
+ *
+ * The pool has a fixed number of threads and a bounded queue, hence the
+ * total number of threads used for parallel processing does not grow
+ * with the number of concurrent requests. Submitting fails when the
+ * queue is full, in which case the caller does the work by itself.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace TimeSeries
+{
+class TaskPool
+{
+ public:
+  TaskPool(std::size_t theThreads, std::size_t theMaxQueued);
+  ~TaskPool();
+  TaskPool(const TaskPool& other) = delete;
+  TaskPool& operator=(const TaskPool& other) = delete;
+
+  // Returns false if the job was not queued. Queued jobs are dropped on shutdown.
+  bool submit(std::function<void()> theJob);
+
+ private:
+  void run();
+
+  const std::size_t itsMaxQueued;
+
+  std::mutex itsMutex;
+  std::condition_variable itsCondition;
+  std::deque<std::function<void()>> itsJobs;
+  bool itsStopping = false;
+
+  std::vector<std::thread> itsThreads;
+};
+
+}  // namespace TimeSeries
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,232 @@
+#include "Tracing.h"
+#include "State.h"
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace TimeSeries
+{
+namespace
+{
+// Upper limits of the histogram buckets in microseconds, the last bucket is unlimited
+const std::array<std::int64_t, 5> bucket_limits{1000, 10000, 100000, 1000000, 10000000};
+const std::array<const char*, 6> bucket_names{
+    "< 1 ms", "< 10 ms", "< 100 ms", "< 1 s", "< 10 s", ">= 10 s"};
+
+std::string milliseconds(std::chrono::microseconds theDuration)
+{
+  return fmt::format("{:.3f}", theDuration.count() / 1000.0);
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Add a span to the trace
+ */
+// ----------------------------------------------------------------------
+
+void Trace::add(const char* theStage,
+                const std::string& theProducer,
+                std::size_t theLocations,
+                std::chrono::microseconds theDuration)
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    auto pos = std::find_if(itsStages.begin(),
+                            itsStages.end(),
+                            [&](const Stage& stage)
+                            { return stage.name == theStage && stage.producer == theProducer; });
+
+    if (pos == itsStages.end())
+    {
+      itsStages.emplace_back();
+      pos = itsStages.end() - 1;
+      pos->name = theStage;
+      pos->producer = theProducer;
+    }
+
+    ++pos->calls;
+    pos->locations += theLocations;
+    pos->duration += theDuration;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Return a copy of the stages
+ */
+// ----------------------------------------------------------------------
+
+std::vector<Trace::Stage> Trace::stages() const
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  return itsStages;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Format the trace for the X-Trace header
+ *
+ * Example: parse;us=310, qengine;producer=ecmwf;us=5230;calls=12;locations=12
+ */
+// ----------------------------------------------------------------------
+
+std::string Trace::header() const
+{
+  try
+  {
+    std::string ret;
+    for (const auto& stage : stages())
+    {
+      if (!ret.empty())
+        ret += ", ";
+      ret += stage.name;
+      if (!stage.producer.empty())
+        ret.append(";producer=").append(stage.producer);
+      ret.append(";us=").append(Fmi::to_string(stage.duration.count()));
+      if (stage.calls > 1)
+        ret.append(";calls=").append(Fmi::to_string(stage.calls));
+      if (stage.locations > 1)
+        ret.append(";locations=").append(Fmi::to_string(stage.locations));
+    }
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Start a span
+ */
+// ----------------------------------------------------------------------
+
+TraceSpan::TraceSpan(const State& theState,
+                     const char* theStage,
+                     std::string theProducer,
+                     std::size_t theLocations)
+    : itsTrace(theState.getTrace()),
+      itsStage(theStage),
+      itsProducer(std::move(theProducer)),
+      itsLocations(theLocations),
+      itsStart(std::chrono::steady_clock::now())
+{
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief End the span. Tracing must never fail the request.
+ */
+// ----------------------------------------------------------------------
+
+TraceSpan::~TraceSpan()
+{
+  try
+  {
+    const auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - itsStart);
+    itsTrace.add(itsStage, itsProducer, itsLocations, duration);
+  }
+  catch (...)
+  {
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Add the stage totals of a request to the histograms
+ */
+// ----------------------------------------------------------------------
+
+void StageStatistics::record(const Trace& theTrace)
+{
+  try
+  {
+    // Sum the producers of each stage
+    std::map<std::string, std::chrono::microseconds> totals;
+    for (const auto& stage : theTrace.stages())
+      totals[stage.name] += stage.duration;
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    for (const auto& [name, duration] : totals)
+    {
+      auto& histogram = itsHistograms[name];
+      if (histogram.buckets.empty())
+        histogram.buckets.resize(bucket_names.size(), 0);
+
+      ++histogram.requests;
+      histogram.total += duration;
+      histogram.max = std::max(histogram.max, duration);
+
+      std::size_t bucket = 0;
+      while (bucket < bucket_limits.size() && duration.count() >= bucket_limits[bucket])
+        ++bucket;
+      ++histogram.buckets[bucket];
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Output the histograms for the admin interface
+ */
+// ----------------------------------------------------------------------
+
+std::unique_ptr<Spine::Table> StageStatistics::table() const
+{
+  try
+  {
+    auto result = std::make_unique<Spine::Table>();
+    result->setTitle("Stage latencies");
+
+    std::vector<std::string> names{"Stage", "Requests", "Mean (ms)", "Max (ms)"};
+    names.insert(names.end(), bucket_names.begin(), bucket_names.end());
+    result->setNames(names);
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    std::size_t row = 0;
+    for (const auto& [name, histogram] : itsHistograms)
+    {
+      std::size_t column = 0;
+      result->set(column++, row, name);
+      result->set(column++, row, Fmi::to_string(histogram.requests));
+      result->set(column++, row, milliseconds(histogram.total / histogram.requests));
+      result->set(column++, row, milliseconds(histogram.max));
+      for (auto count : histogram.buckets)
+        result->set(column++, row, Fmi::to_string(count));
+      ++row;
+    }
+
+    return result;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace TimeSeries
+}  // namespace Plugin
+}  // namespace SmartMet
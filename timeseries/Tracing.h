@@ -0,0 +1,105 @@
+// ======================================================================
+/*!
+ * \brief Latency tracing of the processing stages of requests
+ *
+ * Each request collects the durations of its stages (location
+ * resolution, engine calls, aggregation, formatting etc) into a Trace
+ * held by the State. Spans of the same stage and producer are summed,
+ * since a stage may be entered once per location and parameter. The
+ * trace is returned in the X-Trace header when debug=1, and the stage
+ * totals of all requests are collected into latency histograms.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <spine/Table.h>
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace TimeSeries
+{
+class State;
+
+class Trace
+{
+ public:
+  struct Stage
+  {
+    std::string name;
+    std::string producer;
+    std::size_t calls = 0;
+    std::size_t locations = 0;
+    std::chrono::microseconds duration{0};
+  };
+
+  void add(const char* theStage,
+           const std::string& theProducer,
+           std::size_t theLocations,
+           std::chrono::microseconds theDuration);
+
+  // Stages in the order of their first appearance
+  std::vector<Stage> stages() const;
+
+  // Value for the X-Trace header
+  std::string header() const;
+
+ private:
+  mutable std::mutex itsMutex;
+  std::vector<Stage> itsStages;
+};
+
+// Measures the duration of a stage until the end of the scope
+class TraceSpan
+{
+ public:
+  TraceSpan(const State& theState,
+            const char* theStage,
+            std::string theProducer = {},
+            std::size_t theLocations = 1);
+  ~TraceSpan();
+  TraceSpan(const TraceSpan& other) = delete;
+  TraceSpan& operator=(const TraceSpan& other) = delete;
+
+ private:
+  Trace& itsTrace;
+  const char* itsStage;
+  std::string itsProducer;
+  std::size_t itsLocations;
+  std::chrono::steady_clock::time_point itsStart;
+};
+
+// Latency histograms of the stages over all requests
+class StageStatistics
+{
+ public:
+  void record(const Trace& theTrace);
+  std::unique_ptr<Spine::Table> table() const;
+
+ private:
+  struct Histogram
+  {
+    std::size_t requests = 0;
+    std::chrono::microseconds total{0};
+    std::chrono::microseconds max{0};
+    std::vector<std::size_t> buckets;
+  };
+
+  mutable std::mutex itsMutex;
+  std::map<std::string, Histogram> itsHistograms;
+};
+
+}  // namespace TimeSeries
+}  // namespace Plugin
+}  // namespace SmartMet
+
+// ======================================================================
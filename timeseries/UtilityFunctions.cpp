@@ -33,6 +33,12 @@ void get_special_parameter_values(const std::string& paramname,
   bool is_time_parameter = TS::is_time_parameter(paramname);
   bool is_location_parameter = TS::is_location_parameter(paramname);
 
+  // Location parameters do not depend on time
+  TS::Value location_value;
+  if (is_location_parameter)
+    location_value = TS::location_parameter(
+        loc, paramname, query.valueformatter, query.timezone, precision, query.crs);
+
   for (const auto& timestep : tlist)
   {
     if (is_time_parameter)
@@ -49,12 +55,7 @@ void get_special_parameter_values(const std::string& paramname,
       result->emplace_back(TS::TimedValue(timestep, value));
     }
     if (is_location_parameter)
-    {
-      TS::Value value = TS::location_parameter(
-          loc, paramname, query.valueformatter, query.timezone, precision, query.crs);
-
-      result->emplace_back(TS::TimedValue(timestep, value));
-    }
+      result->emplace_back(TS::TimedValue(timestep, location_value));
   }
 }
 
@@ -71,7 +72,14 @@ void get_special_parameter_values(const std::string& paramname,
   bool is_location_parameter = TS::is_location_parameter(paramname);
   for (const auto& loc : llist)
   {
+    // Location parameters do not depend on time
+    TS::Value location_value;
+    if (is_location_parameter)
+      location_value = TS::location_parameter(
+          loc, paramname, query.valueformatter, query.timezone, precision, query.crs);
+
     auto timeseries = TS::TimeSeries();
+    timeseries.reserve(tlist.size());
     for (const auto& timestep : tlist)
     {
       if (is_time_parameter)
@@ -88,12 +96,7 @@ void get_special_parameter_values(const std::string& paramname,
         timeseries.emplace_back(TS::TimedValue(timestep, value));
       }
       if (is_location_parameter)
-      {
-        TS::Value value = TS::location_parameter(
-            loc, paramname, query.valueformatter, query.timezone, precision, query.crs);
-
-        timeseries.emplace_back(TS::TimedValue(timestep, value));
-      }
+        timeseries.emplace_back(TS::TimedValue(timestep, location_value));
     }
     if (!timeseries.empty())
       result->push_back(